@@ -0,0 +1,152 @@
+#include "AntiAliasing.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Largest difference of a color channel
+int color_distance(const palette::Color& a, const palette::Color& b) {
+    return std::max({std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b)});
+}
+
+// Bit reversed i as a fraction, spreads consecutive samples evenly over 0..1
+double radical_inverse(int i) {
+    double result = 0;
+    double digit = 0.5;
+    for (; i > 0; i >>= 1, digit /= 2) {
+        if (i & 1) {
+            result += digit;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+AntiAliasing::AntiAliasing(FractalisState* state, Fractalis* fractalis)
+    : state(state), fractalis(fractalis), count(0), complete(false), pixels_calculation_id(0),
+      row_colors(3 * state->screen_w), strength(state->screen_w) {
+}
+
+bool AntiAliasing::run(int iter_limit, uint8_t calculation_id) {
+    complete = false;
+    count = 0;
+    if (AA_SAMPLES <= 0) {
+        return true;
+    }
+    // The frame is finished, its histogram doesn't change until the next one
+    if (EQUALIZE_COLORS) {
+        palette::equalize(state->iterationHistogram(), iter_limit, equalization);
+    }
+
+    // First pass: how many pixels there are per edge strength
+    int histogram[BUCKETS] = {0};
+    for (int y = 0; y < state->screen_h; ++y) {
+        edge_row(y, iter_limit);
+        for (int x = 0; x < state->screen_w; ++x) {
+            if (strength[x] >= AA_EDGE_THRESHOLD) {
+                histogram[strength[x] / BUCKET_SIZE]++;
+            }
+        }
+        if (state->calculation_id != calculation_id) {
+            return false;
+        }
+    }
+
+    // The weakest edges that still fit the budget together with all stronger ones
+    int cutoff = BUCKETS - 1;
+    int edges = histogram[cutoff];
+    while (cutoff > AA_EDGE_THRESHOLD / BUCKET_SIZE && edges + histogram[cutoff - 1] <= MAX_PIXELS) {
+        cutoff--;
+        edges += histogram[cutoff];
+    }
+    const int min_strength = std::max(cutoff * BUCKET_SIZE, AA_EDGE_THRESHOLD);
+
+    // Second pass: supersample them. If the strongest edges alone exceed the budget, every
+    // edges / MAX_PIXELS-th of them is taken, so they are spread over the whole screen
+    int selected = 0;
+    for (int y = 0; y < state->screen_h && count < MAX_PIXELS; ++y) {
+        edge_row(y, iter_limit);
+        for (int x = 0; x < state->screen_w && count < MAX_PIXELS; ++x) {
+            if (strength[x] < min_strength) {
+                continue;
+            }
+            selected++;
+            if (edges <= MAX_PIXELS || static_cast<int64_t>(selected) * MAX_PIXELS / edges > count) {
+                pixels[count++] = {static_cast<int16_t>(x), static_cast<int16_t>(y), supersample(x, y, iter_limit)};
+            }
+        }
+        if (state->calculation_id != calculation_id) {
+            return false;
+        }
+    }
+
+    printf("Antialiasing: %d of %d edge pixels supersampled\n", count, edges);
+    pixels_calculation_id = calculation_id;
+    complete = true;
+    return true;
+}
+
+void AntiAliasing::color_row(int y, int iter_limit) {
+    palette::Color* colors = &row_colors[(y % 3) * state->screen_w];
+    for (int x = 0; x < state->screen_w; ++x) {
+        colors[x] = palette::pixel_color(state->at(x, y), iter_limit, equalization);
+    }
+}
+
+// Rows have to be requested in order from 0, the colors of row y + 1 are computed for row y and kept
+void AntiAliasing::edge_row(int y, int iter_limit) {
+    if (y == 0) {
+        color_row(0, iter_limit);
+    }
+    if (y + 1 < state->screen_h) {
+        color_row(y + 1, iter_limit);
+    }
+
+    const int w = state->screen_w;
+    const palette::Color* above = y > 0 ? &row_colors[((y - 1) % 3) * w] : nullptr;
+    const palette::Color* row = &row_colors[(y % 3) * w];
+    const palette::Color* below = y + 1 < state->screen_h ? &row_colors[((y + 1) % 3) * w] : nullptr;
+
+    for (int x = 0; x < w; ++x) {
+        int distance = 0;
+        if (x > 0) {
+            distance = std::max(distance, color_distance(row[x], row[x - 1]));
+        }
+        if (x + 1 < w) {
+            distance = std::max(distance, color_distance(row[x], row[x + 1]));
+        }
+        if (above) {
+            distance = std::max(distance, color_distance(row[x], above[x]));
+        }
+        if (below) {
+            distance = std::max(distance, color_distance(row[x], below[x]));
+        }
+        strength[x] = static_cast<uint8_t>(distance);
+    }
+}
+
+// The pixel's own sample and AA_SAMPLES more spread over its area, stratified in x and y
+palette::Color AntiAliasing::supersample(int x, int y, int iter_limit) {
+    const palette::Color own = palette::pixel_color(state->at(x, y), iter_limit, equalization);
+    int r = own.r, g = own.g, b = own.b;
+    int samples = 1;
+
+    for (int i = 0; i < AA_SAMPLES; ++i) {
+        const double dx = (i + 0.5) / AA_SAMPLES - 0.5;
+        const double dy = radical_inverse(i) + 0.5 / AA_SAMPLES - 0.5;
+        PixelState sample = {0, 0};
+        if (!fractalis->calculate_sample(x, y, dx, dy, iter_limit, sample)) {
+            continue;
+        }
+        const palette::Color color = palette::pixel_color(sample, iter_limit, equalization);
+        r += color.r;
+        g += color.g;
+        b += color.b;
+        samples++;
+    }
+
+    return {static_cast<uint8_t>((r + samples / 2) / samples), static_cast<uint8_t>((g + samples / 2) / samples),
+            static_cast<uint8_t>((b + samples / 2) / samples)};
+}
@@ -0,0 +1,61 @@
+#ifndef ANTI_ALIASING_H
+#define ANTI_ALIASING_H
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include "palette.h"
+#include "globals.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Antialiasing pass over a finished frame. Pixels whose color differs strongly from a neighbor are
+ * supersampled, their averaged color is kept in a small side buffer that the renderer draws over the
+ * frame. If there are more edge pixels than the sample budget allows, the strongest edges win.
+ */
+class AntiAliasing {
+public:
+    struct Pixel {
+        int16_t x;
+        int16_t y;
+        palette::Color color;
+    };
+
+    AntiAliasing(FractalisState* state, Fractalis* fractalis);
+
+    /**
+     * @brief Supersample the edges of the frame in the pixels of state. Fractalis has to be still set up
+     * for this frame, i.e. call it after finish_frame() and before the next begin_frame().
+     * @return false if the pass was interrupted by a new calculation id.
+     */
+    bool run(int iter_limit, uint8_t calculation_id);
+
+    /** @brief Whether the antialiased pixels are complete and belong to the frame of calculation_id. */
+    bool is_valid(uint8_t calculation_id) const { return complete && pixels_calculation_id == calculation_id; }
+    int size() const { return count; }
+    const Pixel& pixel(int i) const { return pixels[i]; }
+
+private:
+    static constexpr int MAX_PIXELS = AA_SAMPLES > 0 ? AA_SAMPLE_BUDGET / AA_SAMPLES : 1;
+    // Edge strengths are bucketed to pick the cutoff that fits the budget
+    static constexpr int BUCKETS = 16;
+    static constexpr int BUCKET_SIZE = 256 / BUCKETS;
+
+    FractalisState* state;
+    Fractalis* fractalis;
+    Pixel pixels[MAX_PIXELS];
+    int count;
+    volatile bool complete;
+    uint8_t pixels_calculation_id;
+    // Colors of three consecutive rows, row y is in slot y % 3, and the edge strengths of one row
+    std::vector<palette::Color> row_colors;
+    std::vector<uint8_t> strength;
+    // Colors of core1, the renderer equalizes its own on core0 meanwhile
+    palette::Equalization equalization;
+
+    void edge_row(int y, int iter_limit);
+    void color_row(int y, int iter_limit);
+    palette::Color supersample(int x, int y, int iter_limit);
+};
+
+#endif // ANTI_ALIASING_H
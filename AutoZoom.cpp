@@ -12,7 +12,6 @@ void AutoZoom::dive() {
     static bool panned = false;
     static uint16_t skip_counter = 0;
     if (!state->auto_zoom) return;
-    state->skip_pre_render = true;
 
     if (skip_counter > 0) {
         skip_counter--;
@@ -25,7 +24,8 @@ void AutoZoom::dive() {
         initiatePan(zoomPoint.first, zoomPoint.second);
         panned = true;
     } else {
-        fractalis->zoom(ZOOM_CONSTANT/1.5L);
+        // Slower than a button press, except for power of two steps, only they can reuse pixels
+        fractalis->zoom(ZOOM_POWER_OF_TWO ? ZOOM_CONSTANT : ZOOM_CONSTANT/1.5L);
         panned = false;
     }
     const uint8_t sleep_s = 1;
@@ -104,14 +104,14 @@ int AutoZoom::countPixelChanges(int tileX, int tileY) {
 
             if (currentX >= state->screen_w || currentY >= state->screen_h) continue;
 
-            uint16_t currentIteration = state->pixelState[currentY][currentX].iteration;
+            uint16_t currentIteration = state->at(currentX, currentY).iteration;
 
             if (x > 0) {
-                uint16_t leftIteration = state->pixelState[currentY][currentX - 1].iteration;
+                uint16_t leftIteration = state->at(currentX - 1, currentY).iteration;
                 if (currentIteration != leftIteration) changeCount++;
             }
             if (y > 0) {
-                uint16_t topIteration = state->pixelState[currentY - 1][currentX].iteration;
+                uint16_t topIteration = state->at(currentX, currentY - 1).iteration;
                 if (currentIteration != topIteration) changeCount++;
             }
         }
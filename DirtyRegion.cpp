@@ -0,0 +1,86 @@
+#include "DirtyRegion.hpp"
+#include <algorithm>
+#include <climits>
+
+DirtyRegion::DirtyRegion(int screen_w, int screen_h)
+    : screen_w(screen_w), screen_h(screen_h), count(0) {
+}
+
+void DirtyRegion::add(const ScreenRect& rect) {
+    ScreenRect clipped = {static_cast<int16_t>(std::max<int>(rect.x1, 0)), static_cast<int16_t>(std::max<int>(rect.y1, 0)),
+                          static_cast<int16_t>(std::min<int>(rect.x2, screen_w - 1)),
+                          static_cast<int16_t>(std::min<int>(rect.y2, screen_h - 1))};
+    if (clipped.x1 > clipped.x2 || clipped.y1 > clipped.y2) {
+        return;
+    }
+
+    if (count == MAX_RECTS) {
+        // No room, it goes into the rectangle it grows the least
+        int best = 0;
+        int best_growth = INT_MAX;
+        for (int i = 0; i < count; ++i) {
+            int growth = area(unite(rects[i], clipped)) - area(rects[i]);
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        rects[best] = unite(rects[best], clipped);
+        merge_into(best);
+        return;
+    }
+    rects[count++] = clipped;
+    merge_into(count - 1);
+}
+
+void DirtyRegion::add_all() {
+    rects[0] = {0, 0, static_cast<int16_t>(screen_w - 1), static_cast<int16_t>(screen_h - 1)};
+    count = 1;
+}
+
+void DirtyRegion::flush(DisplayOutput& output) {
+    int total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += area(rects[i]);
+    }
+    if (total >= FULL_SHARE * screen_w * screen_h) {
+        output.update();
+    } else {
+        for (int i = 0; i < count; ++i) {
+            output.update(rects[i]);
+        }
+    }
+    output.end_frame();
+    count = 0;
+}
+
+int DirtyRegion::area(const ScreenRect& rect) {
+    return (rect.x2 - rect.x1 + 1) * (rect.y2 - rect.y1 + 1);
+}
+
+ScreenRect DirtyRegion::unite(const ScreenRect& a, const ScreenRect& b) {
+    return {std::min(a.x1, b.x1), std::min(a.y1, b.y1), std::max(a.x2, b.x2), std::max(a.y2, b.y2)};
+}
+
+// A merge grows the rectangle, which can make it worth merging with one it wasn't before
+void DirtyRegion::merge_into(int i) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int j = 0; j < count; ++j) {
+            if (j == i) {
+                continue;
+            }
+            ScreenRect united = unite(rects[i], rects[j]);
+            if (area(united) <= area(rects[i]) + area(rects[j]) + MERGE_SLACK) {
+                rects[i] = united;
+                rects[j] = rects[--count];
+                if (i == count) {
+                    i = j;
+                }
+                merged = true;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef DIRTY_REGION_H
+#define DIRTY_REGION_H
+
+#include "DisplayOutput.hpp"
+#include "rectqueue.h"
+#include <cstdint>
+
+/**
+ * The parts of the frame buffer that changed since the last flush, as a few rectangles. A rectangle that
+ * overlaps or nearly touches another one is merged into it when the pixels the union adds cost less than the
+ * window command it saves. Once the rectangles cover most of the screen, one full update is sent instead.
+ */
+class DirtyRegion {
+public:
+    static constexpr int MAX_RECTS = 8;
+
+    DirtyRegion(int screen_w, int screen_h);
+
+    /** @brief Mark the pixels of rect, clipped to the screen, as changed. */
+    void add(const ScreenRect& rect);
+    void add_all();
+    bool empty() const { return count == 0; }
+
+    /** @brief Send the changed parts to output and start over. */
+    void flush(DisplayOutput& output);
+
+private:
+    int screen_w;
+    int screen_h;
+    ScreenRect rects[MAX_RECTS];
+    int count;
+
+    // Extra pixels a merge may add, about as many bytes as a window command and the gaps between transfers
+    static constexpr int MERGE_SLACK = 64;
+    // Share of the screen from which a full update is sent, a single window without per rectangle overhead
+    static constexpr float FULL_SHARE = 0.6f;
+
+    static int area(const ScreenRect& rect);
+    static ScreenRect unite(const ScreenRect& a, const ScreenRect& b);
+    // Merge rects[i] with every other rectangle it is worth merging with
+    void merge_into(int i);
+};
+
+#endif // DIRTY_REGION_H
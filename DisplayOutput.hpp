@@ -0,0 +1,28 @@
+#ifndef DISPLAY_OUTPUT_H
+#define DISPLAY_OUTPUT_H
+
+#include "rectqueue.h"
+#include <cstdint>
+
+/**
+ * Where the frame buffer goes, the ST7789 over SPI on the pico (St7789Output) or a recorder on the host
+ * (MockDisplayOutput). Transfers are windowed: a rectangle costs a window command plus its pixels.
+ */
+class DisplayOutput {
+public:
+    // RGB565 on the wire, whatever the pen format of the frame buffer is
+    static constexpr int BYTES_PER_PIXEL = 2;
+    // Column and row address set with 4 bytes of arguments each, and the memory write command
+    static constexpr int WINDOW_BYTES = 11;
+
+    virtual ~DisplayOutput() = default;
+
+    /** @brief Send the whole frame buffer. */
+    virtual void update() = 0;
+    /** @brief Send the pixels from (x1, y1) to (x2, y2) of the frame buffer, corners included. */
+    virtual void update(const ScreenRect& rect) = 0;
+    /** @brief The updates of one display refresh are sent. */
+    virtual void end_frame() {}
+};
+
+#endif // DISPLAY_OUTPUT_H
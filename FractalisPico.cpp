@@ -11,6 +11,14 @@
 #include "FractalisState.h"
 #include "fractalis.h"
 #include "AutoZoom.hpp"
+#include "MarianiSilver.hpp"
+#include "Progressive.hpp"
+#include "AntiAliasing.hpp"
+#include "TileScheduler.hpp"
+#include "DirtyRegion.hpp"
+#include "St7789Output.hpp"
+#include "palette.h"
+#include "stats.h"
 #include "globals.h"
 #include "doubledouble.h"
 #include <chrono>
@@ -25,6 +33,11 @@ const uint16_t height = 240;
 
 ST7789 st7789(width, height, ROTATE_0, false, get_spi_pins(BG_SPI_FRONT));
 PicoGraphics_PenRGB332 display(st7789.width, st7789.height, nullptr);
+St7789Output output(st7789, display);
+// Parts of the frame buffer to send with the next display update
+DirtyRegion dirty(width, height);
+// Color mapping of the renderer on core0, equalized at every whole screen render
+palette::Equalization equalization = {};
 RGBLED led(PicoDisplay::LED_R, PicoDisplay::LED_G, PicoDisplay::LED_B);
 Button button_a(PicoDisplay::A);
 Button button_b(PicoDisplay::B);
@@ -34,6 +47,10 @@ Button button_y(PicoDisplay::Y);
 FractalisState state(width, height);
 Fractalis fractalis(&state);
 AutoZoom autoZoom(&state, &fractalis);
+MarianiSilver marianiSilver(&state, &fractalis);
+TileScheduler scheduler(&state);
+Progressive progressive(&state, &fractalis, &scheduler);
+AntiAliasing antiAliasing(&state, &fractalis);
 
 void core1_entry();
 void initialize_state();
@@ -42,9 +59,11 @@ void update_display();
 void update_led();
 void update_iter_limit();
 void render_fractal();
+uint32_t render_area(int x1, int y1, int x2, int y2);
 void render_overlay();
 void handle_input();
 void calculate_pixel_concentric(int x, int y);
+void calculate_concentric(uint8_t calculation_id);
 void initialize_rand();
 
 
@@ -78,7 +97,11 @@ int main() {
         update_display();
         if (state.auto_zoom && state.calculating <= 0 && state.rendering <= 0)
             autoZoom.dive();
-        sleep_ms(UPDATE_SLEEP);
+        // Calculate tiles of core1's frame until the next tick instead of sleeping through it
+        absolute_time_t next_tick = make_timeout_time_ms(UPDATE_SLEEP);
+        while (!time_reached(next_tick) && scheduler.help()) {
+        }
+        sleep_until(next_tick);
     }
 
     cleanup_state();
@@ -95,146 +118,206 @@ void initialize_state() {
 
 void core1_entry() {
     printf("Core1 started\n");
-    int center_x = state.screen_w / 2;
-    int center_y = state.screen_h / 2;
-    int max_radius = std::max(center_x, center_y);
-    
     while(true) {
         if (state.calculating <= 0) {
             sleep_ms(UPDATE_SLEEP);
             continue;
         }
 
-        update_iter_limit();
-
-        if (state.skip_pre_render) {
-            state.calculating = 1;
+        // Zoom and pan wait for the frame to stop before they move the pixels
+        uint8_t current_calculation_id;
+        if (!state.beginFrame(current_calculation_id)) {
+            continue;
         }
-
-
-        uint8_t current_calculation_id = state.calculation_id;
-        uint16_t pixels_calculated = 0;
-        for(int radius = 0; radius <= max_radius; ++radius) {
-            if (state.calculation_id != current_calculation_id) {
-                printf("Calculation interrupted at radius %d, restarting\n", radius);
-                if (!state.skip_pre_render) {
-                    state.calculating = 2;
-                }
-                // Reset the state of the last rendered radius
-                radius--;
-                int center_x = state.screen_w / 2;
-                int center_y = state.screen_h / 2;
-                state.resetPixelComplete(center_x - radius, center_y - radius, center_x + radius, center_y - radius);
-                state.resetPixelComplete(center_x - radius, center_y + radius, center_x + radius, center_y + radius);
-                state.resetPixelComplete(center_x - radius, center_y - radius, center_x - radius, center_y + radius);
-                state.resetPixelComplete(center_x + radius, center_y - radius, center_x + radius, center_y + radius);
-                break;
-            }
-            for(int x = -radius; x <= radius; ++x) {
-                fractalis.calculate_pixel(center_x + x, center_y + radius, state.iteration_limit);
-                fractalis.calculate_pixel(center_x + x, center_y - radius, state.iteration_limit);
-                pixels_calculated += 2;
-            }
-            for(int y = -radius + 1; y < radius; ++y) {
-                fractalis.calculate_pixel(center_x + radius, center_y + y, state.iteration_limit);
-                fractalis.calculate_pixel(center_x - radius, center_y + y, state.iteration_limit);
-                pixels_calculated += 2;
+        update_iter_limit();
+        const bool pre_render = state.calculating >= 2;
+
+        absolute_time_t start_time = get_absolute_time();
+        fractalis.begin_frame(state.iteration_limit);
+        if (state.render_mode == RENDER_PROGRESSIVE) {
+            progressive.render(state.iteration_limit, current_calculation_id);
+        } else if (state.render_mode == RENDER_MARIANI_SILVER) {
+            if (!marianiSilver.render(state.iteration_limit, current_calculation_id)) {
+                state.calculating = 2;
             }
+        } else {
+            calculate_concentric(current_calculation_id);
+        }
 
-            if (pixels_calculated >= UPDATE_INTERVAL) {
-                state.last_updated_radius = radius;
-                pixels_calculated = 0;
-            }
+        if (state.calculation_id == current_calculation_id) {
+            fractalis.finish_frame(state.iteration_limit);
         }
 
-        printf("Core1: Pixel calculation complete for iteration limit: %d. Pre-render: %d\n", state.iteration_limit, !state.skip_pre_render);
+        const int64_t took_us = absolute_time_diff_us(start_time, get_absolute_time());
+        printf("Core1: Pixel calculation complete for iteration limit: %d. Pre-render: %d. Tier: %d, took %d ms\n",
+               state.iteration_limit, pre_render, static_cast<int>(fractalis.get_tier()),
+               static_cast<int>(took_us / 1000));
+        stats::add_time(stats::COMPUTE, static_cast<uint32_t>(took_us));
+        stats::report();
+        bool antialias = false;
         if (state.calculation_id == current_calculation_id) {
-            if (!state.skip_pre_render && state.calculating >= 2) {
-                state.resetPixelComplete();
+            if (state.calculating >= 2) {
+                state.resetUnfinishedPixels(state.iteration_limit);
                 state.rendering = 3;  // Trigger a full render
                 state.calculating = 1;
             } else if (state.calculating == 1) {
                 state.rendering = 3;  // Trigger a full render
                 state.calculating = 0;
+                antialias = AA_SAMPLES > 0;
             }
         }
+        // Antialiasing only reads the pixels, its result is dropped if the view changes meanwhile
+        state.endFrame();
+        if (antialias && antiAliasing.run(state.iteration_limit, current_calculation_id)) {
+            state.rendering = 1;  // Draw the antialiased edges
+        }
     }
 }
 
-void cleanup_state() {
-    for(int i = 0; i < state.screen_h; ++i) {
-        delete[] state.pixelState[i];
+void calculate_concentric(uint8_t calculation_id) {
+    int center_x = state.screen_w / 2;
+    int center_y = state.screen_h / 2;
+    int max_radius = std::max(center_x, center_y);
+    // Pixels of the current ring: two sides of 2 * max_radius + 1 pixels each, two of 2 * max_radius - 1
+    static PixelCoord ring[8 * (width > height ? width : height) / 2 + 4];
+
+    for(int radius = 0; radius <= max_radius; ++radius) {
+        if (state.calculation_id != calculation_id) {
+            printf("Calculation interrupted at radius %d, restarting\n", radius);
+            stats::count(stats::INTERRUPTED_PASSES);
+            state.calculating = 2;
+            // Reset the state of the last rendered radius
+            radius--;
+            int center_x = state.screen_w / 2;
+            int center_y = state.screen_h / 2;
+            state.resetPixelComplete(center_x - radius, center_y - radius, center_x + radius, center_y - radius);
+            state.resetPixelComplete(center_x - radius, center_y + radius, center_x + radius, center_y + radius);
+            state.resetPixelComplete(center_x - radius, center_y - radius, center_x - radius, center_y + radius);
+            state.resetPixelComplete(center_x + radius, center_y - radius, center_x + radius, center_y + radius);
+            break;
+        }
+        // One batch per ring, so the kernel can keep all of its lanes busy
+        int ring_size = 0;
+        for(int x = -radius; x <= radius; ++x) {
+            ring[ring_size++] = {static_cast<int16_t>(center_x + x), static_cast<int16_t>(center_y + radius)};
+            ring[ring_size++] = {static_cast<int16_t>(center_x + x), static_cast<int16_t>(center_y - radius)};
+        }
+        for(int y = -radius + 1; y < radius; ++y) {
+            ring[ring_size++] = {static_cast<int16_t>(center_x + radius), static_cast<int16_t>(center_y + y)};
+            ring[ring_size++] = {static_cast<int16_t>(center_x - radius), static_cast<int16_t>(center_y + y)};
+        }
+        fractalis.calculate_pixels(ring, ring_size, state.iteration_limit);
+
+        // The four sides of the ring
+        const int16_t left = center_x - radius, right = center_x + radius;
+        const int16_t top = center_y - radius, bottom = center_y + radius;
+        state.finished[CORE1].push({left, top, right, top});
+        state.finished[CORE1].push({left, bottom, right, bottom});
+        state.finished[CORE1].push({left, top, left, bottom});
+        state.finished[CORE1].push({right, top, right, bottom});
     }
-    delete[] state.pixelState;
+}
+
+void cleanup_state() {
+    // The pixel store is freed by ~FractalisState()
     printf("State cleaned up\n");
 }
 
 void update_display() {
     if (state.rendering <= 0)
         return;
+    const uint32_t render_start = time_us_32();
     if (state.rendering > 0)
         render_fractal();
 
+    // The overlay is drawn over every update, it only changes with the whole screen. Where it covers an
+    // updated area it is part of the frame buffer by the time that is sent
     render_overlay();
+    const uint32_t flush_start = time_us_32();
+    stats::add_time(stats::RENDER, flush_start - render_start);
 
     // Update the display after rendering the fractal and overlay
-    st7789.update(&display);
+    dirty.flush(output);
+    stats::add_time(stats::FLUSH, time_us_32() - flush_start);
 }
 
-void render_fractal() {
-    static const uint16_t PIXEL_SHIFT_X = static_cast<int>(PAN_CONSTANT * state.screen_w);
-    static const uint16_t PIXEL_SHIFT_Y = static_cast<int>(PAN_CONSTANT * state.screen_h * state.ASPECT_RATIO);
-    
-    int start_x = 0, end_x = state.screen_w;
-    int start_y = 0, end_y = state.screen_h;
-    
-    if (state.rendering == 2) {
-        if (state.last_pan_direction == PAN_LEFT) {
-            start_x = 0;
-            end_x = PIXEL_SHIFT_X;
-        } else if (state.last_pan_direction == PAN_RIGHT) {
-            start_x = state.screen_w - PIXEL_SHIFT_X;
-            end_x = state.screen_w;
-        } else if (state.last_pan_direction == PAN_UP) {
-            start_y = 0;
-            end_y = PIXEL_SHIFT_Y;
-        } else if (state.last_pan_direction == PAN_DOWN) {
-            start_y = state.screen_h - PIXEL_SHIFT_Y;
-            end_y = state.screen_h;
-        }
-        printf("start_x, end_x: %d, %d\n", start_x, end_x);
-        printf("start_y, end_y: %d, %d\n", start_y, end_y);
-    }
-    // For state.rendering == 3, we'll render the full screen
+// Draws the pixels from (x1, y1) to (x2, y2), clipped to the screen, that are calculated, and in a progressive pass the ones that are
+// covered by the block of a coarser sample. Returns the number of calculated pixels
+uint32_t render_area(int x1, int y1, int x2, int y2) {
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, state.screen_w - 1);
+    y2 = std::min(y2, state.screen_h - 1);
 
     uint32_t pixel_rendered_counter = 0;
-    uint32_t total_pixels = (end_x - start_x) * (end_y - start_y);
-
-    for(int y = start_y; y < end_y; ++y) {
-        for(int x = start_x; x < end_x; ++x) {
-            if (!state.pixelState[y][x].isComplete()) {
-                continue;
-            } else if (state.pixelState[y][x].iteration >= state.iteration_limit) {
-                display.set_pen(0, 0, 0);
+    for(int y = y1; y <= y2; ++y) {
+        for(int x = x1; x <= x2; ++x) {
+            const PixelState* pixel = &state.at(x, y);
+            if (state.isPixelComplete(x, y)) {
+                pixel_rendered_counter++;
+            } else if (state.render_mode == RENDER_PROGRESSIVE) {
+                // Drawn as part of the block of a coarser sample until it is calculated itself
+                pixel = Progressive::block_sample(state, x, y);
+                if (pixel == nullptr) {
+                    continue;
+                }
             } else {
-                float iteration_ratio = std::log(1 + state.pixelState[y][x].getSmoothIterationFloat()) / 2.0f;
-                float hue = fmodf(START_HUE + iteration_ratio, 1.0f);
-                float saturation = std::min(iteration_ratio / SATURATION_THRESHOLD, 1.0f);
-                float value = std::min(iteration_ratio / VALUE_THRESHOLD, 1.0f);
-                display.set_pen(display.create_pen_hsv(hue, saturation, value));
+                continue;
             }
-            pixel_rendered_counter++;
+
+            palette::Color color = palette::pixel_color(*pixel, state.iteration_limit, equalization);
+            display.set_pen(color.r, color.g, color.b);
             display.pixel(Point(x, y));
         }
     }
+    return pixel_rendered_counter;
+}
 
-    if (pixel_rendered_counter >= total_pixels) {
-        if (state.rendering == 3) {
-            state.rendering = 2;  // Set to 2 to indicate partial renders are now possible
-        } else {
-            state.rendering = 0;
-            state.last_pan_direction = PAN_NONE;
+void render_fractal() {
+    // Both queues are asked, a lost area of either one needs the whole screen
+    const bool overflowed = state.finished[CORE0].overflowed() | state.finished[CORE1].overflowed();
+    uint8_t rendering = state.rendering;
+
+    if (rendering == 2 && !overflowed) {
+        // Only what the cores finished since the last update
+        ScreenRect rect;
+        for (RectQueue& queue : state.finished) {
+            while (queue.pop(rect)) {
+                render_area(rect.x1, rect.y1, rect.x2, rect.y2);
+                dirty.add(rect);
+            }
         }
+        return;
+    }
+
+    // The whole screen covers everything queued until now. A request for another full render that core1
+    // makes while it is drawn is kept, the exchange fails then
+    for (RectQueue& queue : state.finished) {
+        queue.clear();
+    }
+    if (rendering != 2 && !state.rendering.compare_exchange_strong(rendering, 2)) {
+        return;
+    }
+    // The color mapping only changes with the whole screen, areas drawn until the next full render match it
+    if (EQUALIZE_COLORS) {
+        palette::equalize(state.iterationHistogram(), state.iteration_limit, equalization);
+    }
+    uint32_t pixel_rendered_counter = render_area(0, 0, state.screen_w - 1, state.screen_h - 1);
+    dirty.add_all();
+
+    // Edge pixels of the finished frame, supersampled on core1
+    if (antiAliasing.is_valid(state.calculation_id)) {
+        for (int i = 0; i < antiAliasing.size(); ++i) {
+            const AntiAliasing::Pixel& pixel = antiAliasing.pixel(i);
+            display.set_pen(pixel.color.r, pixel.color.g, pixel.color.b);
+            display.pixel(Point(pixel.x, pixel.y));
+        }
+    }
+
+    uint8_t partial = 2;
+    if (pixel_rendered_counter >= static_cast<uint32_t>(state.screen_w * state.screen_h) &&
+        state.rendering.compare_exchange_strong(partial, 0)) {
+        state.last_pan_direction = PAN_NONE;
     }
 }
 
@@ -339,11 +422,8 @@ void update_led() {
 }
 
 void update_iter_limit() {
-    if (state.zoom_factor > 1e6)
-        state.skip_pre_render = true;
-    else
-        state.skip_pre_render = false;
-
+    // The pre-render is not thrown away: its escaped and interior pixels are final and the orbits that
+    // reached its limit are continued from the orbit pool, so it pays off at any depth and in every mode
     if (state.calculating == 0)
         return;
     double scale = state.screen_w / (3.0 / state.zoom_factor);
@@ -352,9 +432,9 @@ void update_iter_limit() {
         max_iter = MAX_ITER;
     }
 
-    if (state.calculating == 1 || state.skip_pre_render) {
+    if (state.calculating == 1) {
         state.iteration_limit = max_iter;
-    } else if (state.calculating == 2 && !state.skip_pre_render) {
+    } else if (state.calculating == 2) {
         int divider = 6;
         if (state.zoom_factor > 1e4)
             divider -= 1;
@@ -407,8 +487,8 @@ void handle_input() {
                         fractalis.pan(0, -PAN_CONSTANT);
                         break;
                     case 3: // Button Y: Zoom
-                        fractalis.zoom(-ZOOM_CONSTANT);
-                        state.resetPixelComplete();
+                        // Power of two steps zoom out by the inverse of zooming in, so the pixels of the frame before can be reused
+                        fractalis.zoom(ZOOM_POWER_OF_TWO ? -ZOOM_CONSTANT / (1 + ZOOM_CONSTANT) : -ZOOM_CONSTANT);
                         state_changed = true;
                         break;
                 }
@@ -431,9 +511,10 @@ void handle_input() {
                         fractalis.pan(PAN_CONSTANT, 0);
                         break;
                     case 3: // Button Y: Zoom
-                        state_changed = true;
-                        fractalis.zoom(ZOOM_CONSTANT);
-                        state.resetPixelComplete();
+                        if (state.zoom_factor < MAX_ZOOM) {
+                            state_changed = true;
+                            fractalis.zoom(ZOOM_CONSTANT);
+                        }
                         break;
                 }
             }
@@ -453,7 +534,6 @@ void handle_input() {
     if (state_changed) {
         state.calculating = 2;
         state.calculation_id++;
-        state.last_updated_radius = 0;
         state.rendering = 3;
     }
 }
@@ -1,40 +1,154 @@
 #include "FractalisState.h"
 #include "globals.h"
 #include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
 
 FractalisState::FractalisState(int width, int height)
-    : screen_w(width), screen_h(height), zoom_factor(1.0), pan_real(0), pan_imag(0), led_skip_counter(0), skip_pre_render(false), hide_ui(false), last_pan_direction(PAN_NONE), auto_zoom(false),
-      last_updated_radius(0), calculating(0), calculation_id(0), rendering(0), iteration_limit(25), color_iteration_limit(25) {
+    : screen_w(width), screen_h(height), zoom_factor(1.0), pan_real(0), pan_imag(0), led_skip_counter(0), hide_ui(false), last_pan_direction(PAN_NONE), auto_zoom(false), render_mode(DEFAULT_RENDER_MODE),
+      calculating(0), calculation_id(0), rendering(0), iteration_limit(25),
+      view_changing(false), origin_x(0), origin_y(0) {
 
     center = {-0.5, 0};
     ASPECT_RATIO = static_cast<double>(width) / static_cast<double>(height);
 
-    pixelState = new PixelState*[screen_h];
-    for (int i = 0; i < screen_h; ++i) {
-        pixelState[i] = new PixelState[screen_w];
-        for (int j = 0; j < screen_w; ++j) {
-            pixelState[i][j].setIterationAndComplete(0, false);
-            pixelState[i][j].smooth_iteration = 0;
-        }
-    }
+    pixels = new PixelState[screen_w * screen_h]();
+    bitmap_stride = (screen_w + 31) / 32;
+    complete_bits = new uint32_t[bitmap_stride * screen_h]();
+    clearHistogram();
 }
 
 FractalisState::~FractalisState() {
-    for (int i = 0; i < screen_h; ++i) {
-        delete[] pixelState[i];
-    }
-    delete[] pixelState;
+    delete[] pixels;
+    delete[] complete_bits;
 }
 
 void FractalisState::resetPixelComplete(int x1, int y1, int x2, int y2) {
-    resetPixelCompleteInternal(x1, y1, x2, y2);
+    fillComplete(x1, y1, x2, y2, false);
 }
 
 void FractalisState::resetPixelComplete() {
-    resetPixelCompleteInternal(0, 0, screen_w - 1, screen_h - 1);
+    std::memset(complete_bits, 0, bitmap_stride * screen_h * sizeof(uint32_t));
+    clearHistogram();
+}
+
+void FractalisState::setPixelComplete(int x1, int y1, int x2, int y2) {
+    fillComplete(x1, y1, x2, y2, true);
+}
+
+// Neither the order of the pixels nor their position on screen matter, the store is walked as it is
+void FractalisState::resetUnfinishedPixels(int iter_limit) {
+    for (int sy = 0; sy < screen_h; ++sy) {
+        uint32_t* words = complete_bits + sy * bitmap_stride;
+        const PixelState* row = pixels + sy * screen_w;
+        for (int word = 0; word < bitmap_stride; ++word) {
+            uint32_t complete = words[word];
+            while (complete) {
+                const int bit = __builtin_ctz(complete);
+                complete &= complete - 1;
+                if (row[word * 32 + bit].iteration == iter_limit) {
+                    words[word] &= ~(1u << bit);
+                    countPixel(row[word * 32 + bit], -1);
+                }
+            }
+        }
+    }
+}
+
+void FractalisState::clearHistogram() {
+    for (auto& count : histogram) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+int FractalisState::nextIncompletePixel(int y, int x1, int x2) const {
+    if (x1 > x2) {
+        return x2 + 1;
+    }
+    const uint32_t* words = complete_bits + storageY(y) * bitmap_stride;
+    // The span in the store, split in two where it wraps around
+    const int start = storageX(x1);
+    const int length = x2 - x1 + 1;
+    const int first_end = std::min(start + length, screen_w);
+    int segments[2][2] = {{start, first_end - 1}, {0, start + length - first_end - 1}};
+
+    int skipped = 0;
+    for (const auto& segment : segments) {
+        const int a = segment[0];
+        const int b = segment[1];
+        if (a > b) {
+            break;
+        }
+        for (int word = a >> 5; word <= (b >> 5); ++word) {
+            uint32_t incomplete = ~words[word];
+            if (word == (a >> 5)) {
+                incomplete &= ~0u << (a & 31);
+            }
+            if (word == (b >> 5)) {
+                incomplete &= ~0u >> (31 - (b & 31));
+            }
+            if (incomplete) {
+                return x1 + skipped + word * 32 + __builtin_ctz(incomplete) - a;
+            }
+        }
+        skipped += b - a + 1;
+    }
+    return x2 + 1;
+}
+
+void FractalisState::fillCompleteBits(int y, int x1, int x2, bool complete, bool counted) {
+    const int sy = storageY(y);
+    uint32_t* words = complete_bits + sy * bitmap_stride;
+    const PixelState* row = pixels + sy * screen_w;
+    const int start = storageX(x1);
+    const int length = x2 - x1 + 1;
+    const int first_end = std::min(start + length, screen_w);
+    int segments[2][2] = {{start, first_end - 1}, {0, start + length - first_end - 1}};
+
+    for (const auto& segment : segments) {
+        const int a = segment[0];
+        const int b = segment[1];
+        if (a > b) {
+            break;
+        }
+        const int first = a >> 5;
+        const int last = b >> 5;
+        if (!counted) {
+            const uint32_t first_mask = ~0u << (a & 31);
+            const uint32_t last_mask = ~0u >> (31 - (b & 31));
+            if (first == last) {
+                words[first] = complete ? words[first] | (first_mask & last_mask) : words[first] & ~(first_mask & last_mask);
+                continue;
+            }
+            words[first] = complete ? words[first] | first_mask : words[first] & ~first_mask;
+            std::memset(words + first + 1, complete ? 0xFF : 0, (last - first - 1) * sizeof(uint32_t));
+            words[last] = complete ? words[last] | last_mask : words[last] & ~last_mask;
+            continue;
+        }
+        // Only the pixels whose bit flips enter or leave the histogram
+        for (int word = first; word <= last; ++word) {
+            uint32_t mask = ~0u;
+            if (word == first) {
+                mask &= ~0u << (a & 31);
+            }
+            if (word == last) {
+                mask &= ~0u >> (31 - (b & 31));
+            }
+            uint32_t flipped = complete ? mask & ~words[word] : mask & words[word];
+            words[word] ^= flipped;
+            while (flipped) {
+                countPixel(row[word * 32 + __builtin_ctz(flipped)], complete ? 1 : -1);
+                flipped &= flipped - 1;
+            }
+        }
+    }
 }
 
-void FractalisState::resetPixelCompleteInternal(int x1, int y1, int x2, int y2) {
+void FractalisState::fillComplete(int x1, int y1, int x2, int y2, bool complete) {
     x1 = std::max(0, std::min(x1, screen_w - 1));
     y1 = std::max(0, std::min(y1, screen_h - 1));
     x2 = std::max(0, std::min(x2, screen_w - 1));
@@ -44,75 +158,89 @@ void FractalisState::resetPixelCompleteInternal(int x1, int y1, int x2, int y2)
     if (y1 > y2) std::swap(y1, y2);
 
     for (int y = y1; y <= y2; ++y) {
-        for (int x = x1; x <= x2; ++x) {
-            pixelState[y][x].setIterationAndComplete(0, false);
-            pixelState[y][x].smooth_iteration = 0;
-        }
+        fillCompleteBits(y, x1, x2, complete, true);
     }
 }
 
+// Screen pixel (x, y) shows what was at (x - dx, y - dy) before. Only the origin of the ring buffer moves,
+// the pixels that wrapped around are the exposed strip and get reset
 void FractalisState::shiftPixelState(int dx, int dy) {
     if (dx == 0 && dy == 0) {
         return;
     }
+    dx = std::max(-screen_w, std::min(dx, screen_w));
+    dy = std::max(-screen_h, std::min(dy, screen_h));
 
-    // Horizontal shift
-    if (dx != 0) {
-        for (int y = 0; y < screen_h; ++y) {
-            if (dx > 0) {
-                // Shift to the right
-                for (int x = screen_w - 1; x >= dx; --x) {
-                    pixelState[y][x] = pixelState[y][x - dx];
-                }
-                // Mark newly exposed pixels on the left as incomplete
-                for (int x = 0; x < dx; ++x) {
-                    pixelState[y][x].setIterationAndComplete(0, false);
-                    pixelState[y][x].smooth_iteration = 0;
-                }
-            } else {
-                // Shift to the left
-                for (int x = 0; x < screen_w + dx; ++x) {
-                    pixelState[y][x] = pixelState[y][x - dx];
-                }
-                // Mark newly exposed pixels on the right as incomplete
-                for (int x = screen_w + dx; x < screen_w; ++x) {
-                    pixelState[y][x].setIterationAndComplete(0, false);
-                    pixelState[y][x].smooth_iteration = 0;
-                }
-            }
+    origin_x = (origin_x - dx + screen_w) % screen_w;
+    origin_y = (origin_y - dy + screen_h) % screen_h;
+
+    if (dx > 0) {
+        fillComplete(0, 0, dx - 1, screen_h - 1, false);
+    } else if (dx < 0) {
+        fillComplete(screen_w + dx, 0, screen_w - 1, screen_h - 1, false);
+    }
+    if (dy > 0) {
+        fillComplete(0, 0, screen_w - 1, dy - 1, false);
+    } else if (dy < 0) {
+        fillComplete(0, screen_h + dy, screen_w - 1, screen_h - 1, false);
+    }
+}
+
+// Old index of every index of the new frame along one axis, -1 where the new pixel isn't on an old one
+static std::vector<int> reprojection_sources(int size, int center, double ratio) {
+    std::vector<int> sources(size, -1);
+    for (int i = 0; i < size; ++i) {
+        double old = (i - center) / ratio;
+        double rounded = std::round(old);
+        int source = center + static_cast<int>(rounded);
+        if (old == rounded && source >= 0 && source < size) {
+            sources[i] = source;
         }
     }
+    return sources;
+}
 
-    // Vertical shift
-    if (dy != 0) {
-        if (dy > 0) {
-            // Shift downwards
-            for (int y = screen_h - 1; y >= dy; --y) {
-                for (int x = 0; x < screen_w; ++x) {
-                    pixelState[y][x] = pixelState[y - dy][x];
-                }
-            }
-            // Mark newly exposed pixels at the top as incomplete
-            for (int y = 0; y < dy; ++y) {
-                for (int x = 0; x < screen_w; ++x) {
-                    pixelState[y][x].setIterationAndComplete(0, false);
-                    pixelState[y][x].smooth_iteration = 0;
-                }
-            }
-        } else {
-            // Shift upwards
-            for (int y = 0; y < screen_h + dy; ++y) {
-                for (int x = 0; x < screen_w; ++x) {
-                    pixelState[y][x] = pixelState[y - dy][x];
-                }
-            }
-            // Mark newly exposed pixels at the bottom as incomplete
-            for (int y = screen_h + dy; y < screen_h; ++y) {
-                for (int x = 0; x < screen_w; ++x) {
-                    pixelState[y][x].setIterationAndComplete(0, false);
-                    pixelState[y][x].smooth_iteration = 0;
+// Indices ordered by their distance from the center, ascending or descending
+static std::vector<int> reprojection_order(int size, int center, bool outwards) {
+    std::vector<int> order(size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [center, outwards](int a, int b) {
+        return outwards ? std::abs(a - center) < std::abs(b - center) : std::abs(a - center) > std::abs(b - center);
+    });
+    return order;
+}
+
+void FractalisState::reprojectPixelState(double ratio, int iter_limit) {
+    const int center_x = screen_w / 2;
+    const int center_y = screen_h / 2;
+    std::vector<int> source_x = reprojection_sources(screen_w, center_x, ratio);
+    std::vector<int> source_y = reprojection_sources(screen_h, center_y, ratio);
+    // A source is on the same side of the center as its destination and never closer to it when zooming
+    // out, never farther when zooming in. Visiting the destinations in this order moves every pixel in place
+    // before its own position is overwritten
+    const bool outwards = ratio < 1.0;
+    std::vector<int> order_x = reprojection_order(screen_w, center_x, outwards);
+    std::vector<int> order_y = reprojection_order(screen_h, center_y, outwards);
+
+    // Only kept pixels are counted again, whatever was complete before
+    clearHistogram();
+    int kept = 0;
+    for (int y : order_y) {
+        for (int x : order_x) {
+            PixelState& pixel = at(x, y);
+            if (source_x[x] >= 0 && source_y[y] >= 0 && isPixelComplete(source_x[x], source_y[y])) {
+                pixel = at(source_x[x], source_y[y]);
+                // Interior pixels aren't kept, the periodicity check that found them scales with the pixel
+                // spacing. At a finer one it may not stop them and they escape
+                if (pixel.iteration < iter_limit) {
+                    fillCompleteBits(y, x, x, true, false);
+                    countPixel(pixel, 1);
+                    kept++;
+                    continue;
                 }
             }
+            fillCompleteBits(y, x, x, false, false);
         }
     }
+    printf("Reprojection: %d of %d pixels kept\n", kept, screen_w * screen_h);
 }
@@ -1,8 +1,10 @@
 #ifndef FRACTALIS_STATE_H
 #define FRACTALIS_STATE_H
 
+#include <atomic>
 #include <cstdint>
 #include "doubledouble.h"
+#include "rectqueue.h"
 
 using namespace doubledouble;
 
@@ -14,6 +16,17 @@ enum PAN_DIRECTION {
     PAN_RIGHT
 };
 
+enum RENDER_MODE {
+    RENDER_CONCENTRIC = 0,  // Rings around the center, every pixel is calculated
+    RENDER_MARIANI_SILVER,  // Rectangles with a uniform border are filled, see MarianiSilver
+    RENDER_PROGRESSIVE      // Coarse grid first, refined until every pixel is calculated, see Progressive
+};
+
+enum CORE {
+    CORE0 = 0,  // Input, display and calculation in between
+    CORE1       // Calculation
+};
+
 // Real and imaginary coordinates in the Mandelbrot fractal
 struct Coordinate {
     DoubleDouble real;
@@ -25,41 +38,16 @@ struct Coordinate {
 // using a scale factor like 256 should provide enough precision (1/256 increments).
 #define SMOOTH_ITER_SCALE 1024.0f
 
-// Per-pixel data structure to track iteration counts and current z values
+// Per-pixel result. Whether a pixel is calculated at all is kept apart from it, in the completion bitmap
+// of FractalisState, so skipping complete pixels doesn't have to load them
 struct PixelState {
-    /**
-     * The iteration field is used as follows:
-     * - The lower bit (bit 0) is used to store the "isComplete" flag.
-     * - The remaining 15 bits store the iteration count.
-     *
-     * Layout:
-     *  bits: [15 ..................... 1 | 0 ]
-     *        [      iteration_count      |complete]
-     */
+    // Iterations until the orbit escaped, the iteration limit if it didn't, or INTERIOR
     uint16_t iteration;
     uint16_t smooth_iteration; // Smooth iteration count for coloring
 
-    uint16_t getIterationCount() const {
-        return iteration >> 1;
-    }
-
-    void setIterationCount(uint16_t iteration_count) {
-        bool complete = isComplete();
-        iteration = static_cast<uint16_t>((iteration_count << 1) | (complete ? 1 : 0));
-    }
-
-    bool isComplete() const {
-        return (iteration & 0x1) != 0;
-    }
-
-    void setIsComplete(bool complete) {
-        uint16_t iteration_count = getIterationCount();
-        iteration = static_cast<uint16_t>((iteration_count << 1) | (complete ? 1 : 0));
-    }
-
-    void setIterationAndComplete(uint16_t iteration_count, bool complete) {
-        iteration = static_cast<uint16_t>((iteration_count << 1) | (complete ? 1 : 0));
-    }
+    // Iteration of a complete pixel proven to be inside the set. It is final at any iteration limit,
+    // unlike a pixel that only reached the limit
+    static constexpr uint16_t INTERIOR = 0xFFFF;
 
     void setSmoothIterationFloat(float smooth) {
         // Clamp smooth iteration to fit into uint16_t if necessary
@@ -83,25 +71,89 @@ public:
 
     void resetPixelComplete(int x1, int y1, int x2, int y2);
     void resetPixelComplete();
+    /**
+     * @brief Reset the pixels that stopped at iter_limit without being proven interior, they are undecided at
+     * a higher limit. Escaped and interior pixels keep their final result, also ones kept from an earlier frame
+     * that escaped above iter_limit.
+     */
+    void resetUnfinishedPixels(int iter_limit);
     void shiftPixelState(int dx, int dy);
+    /**
+     * @brief Move the pixels to where they are after zooming by ratio around the screen center, ratio being
+     * the new zoom factor over the old one. Pixels that land exactly on a pixel of the new frame and escaped
+     * below iter_limit are kept, all others are reset.
+     * Zooming in by a power of two in the same tier, a kept pixel is what the new frame would calculate: c is
+     * the same and the periodicity check of the new frame is stricter. Zooming out it is coarser, a direct
+     * render may stop a kept pixel as interior before it escapes. And the iteration limit of the new frame is
+     * lower, a kept pixel can have escaped above it.
+     */
+    void reprojectPixelState(double ratio, int iter_limit);
+
+    /**
+     * @brief Pixel (x, y) of the screen. The store is a ring buffer in both directions, so shiftPixelState()
+     * only moves its origin and resets the exposed strip. Values of incomplete pixels are undefined.
+     */
+    PixelState& at(int x, int y) { return pixels[storageY(y) * screen_w + storageX(x)]; }
+    const PixelState& at(int x, int y) const { return pixels[storageY(y) * screen_w + storageX(x)]; }
+
+    /**
+     * @brief Screen column of column storage_x of the store. Words of the completion bitmap are aligned to store
+     * columns, not to the screen, which differ after a pan.
+     */
+    int screenColumn(int storage_x) const { return wrap(storage_x + screen_w - origin_x, screen_w); }
+
+    bool isPixelComplete(int x, int y) const
+    {
+        const int sx = storageX(x);
+        return (complete_bits[storageY(y) * bitmap_stride + (sx >> 5)] >> (sx & 31)) & 1;
+    }
+    void setPixelComplete(int x, int y)
+    {
+        const int sx = storageX(x);
+        uint32_t& word = complete_bits[storageY(y) * bitmap_stride + (sx >> 5)];
+        const uint32_t bit = 1u << (sx & 31);
+        if (!(word & bit)) {
+            word |= bit;
+            countPixel(at(x, y), 1);
+        }
+    }
+    /** @brief Mark the rectangle from (x1, y1) to (x2, y2), corners included, complete. */
+    void setPixelComplete(int x1, int y1, int x2, int y2);
+    /**
+     * @brief The first incomplete pixel from x1 to x2 of row y, x2 + 1 if there is none. Tests 32 pixels at a time.
+     */
+    int nextIncompletePixel(int y, int x1, int x2) const;
+
+    // Exact below 16 iterations, 16 buckets per power of two above. Covers every iteration count but INTERIOR
+    static constexpr int HISTOGRAM_BUCKETS = 208;
+    static int histogramBucket(int iteration)
+    {
+        if (iteration < 16) {
+            return iteration;
+        }
+        const int exponent = 31 - __builtin_clz(iteration);
+        return (exponent - 3) * 16 + ((iteration >> (exponent - 4)) & 15);
+    }
+    /**
+     * @brief Number of complete pixels per histogramBucket() of their iteration count, interior pixels aside.
+     * Kept up to date as pixels complete and are reset, both cores count into it.
+     */
+    const std::atomic<uint32_t>* iterationHistogram() const { return histogram; }
 
     // Public members
     int screen_w;
     int screen_h;
     double ASPECT_RATIO;
-    PixelState** pixelState;
     Coordinate center;
     double zoom_factor;
     DoubleDouble pan_real;
     DoubleDouble pan_imag;
-    volatile int last_updated_radius;
     PAN_DIRECTION last_pan_direction;
     bool auto_zoom;
+    RENDER_MODE render_mode;
 
     volatile uint8_t led_skip_counter;
 
-    // will be set to true for deep zoom factors to disable low iteration counts
-    volatile bool skip_pre_render;
     volatile bool hide_ui;
 
    /** tracking what calculation is currently in progress. Different values have different meanings
@@ -110,21 +162,85 @@ public:
     * 3: queued calculation
     */
     uint8_t calculating;
-    volatile uint8_t calculation_id;
+    std::atomic<uint8_t> calculation_id;
+
+    /**
+     * @brief Stop the frame in progress and wait until core1 left it, before the view changes and pixels move.
+     * Increments calculation_id, the kernels stop at their next pixel then. Ends with endViewChange().
+     */
+    void beginViewChange() {
+        view_changing.store(true);
+        calculation_id++;
+        lockFrame();
+    }
+    void endViewChange() {
+        view_changing.store(false);
+        unlockFrame();
+    }
+    /**
+     * @brief Start to calculate a frame of calculation id, ends with endFrame().
+     * @return false if a view change is waiting, the frame must not start then.
+     */
+    bool beginFrame(uint8_t& id) {
+        lockFrame();
+        // The id first: a view change that isn't seen yet increments it afterwards and stops this frame
+        id = calculation_id;
+        if (view_changing.load()) {
+            unlockFrame();
+            return false;
+        }
+        return true;
+    }
+    void endFrame() { unlockFrame(); }
 
     /**
      * tracking, if the screen is rendering and if a new rendering is needed. Different values have different meanings
      * 0: Done
-     * 1: Antialiasing pass
-     * 2: screen rendering needed
-     * 3: Whole screen render needed, in case of pan
+     * 1: Antialiasing pass, the whole screen is rendered with the antialiased edges
+     * 2: Areas in finished are rendered as the cores publish them
+     * 3: Whole screen render needed, e.g. after a pan or at the end of a pass
      */
-    volatile uint8_t rendering;
+    std::atomic<uint8_t> rendering;
+    // Areas calculated by each core since the renderer last looked, indexed by CORE
+    RectQueue finished[2];
     volatile uint16_t iteration_limit;
-    volatile uint16_t color_iteration_limit;
 
 private:
-    void resetPixelCompleteInternal(int x1, int y1, int x2, int y2);
+    // screen_w * screen_h pixels in one allocation, row after row
+    PixelState* pixels;
+    // One bit per pixel, set once it is calculated. Rows of bitmap_stride words in the layout of pixels
+    uint32_t* complete_bits;
+    int bitmap_stride;
+    std::atomic<uint32_t> histogram[HISTOGRAM_BUCKETS];
+    // Held by core1 while it calculates a frame and by a view change while it moves the pixels
+    std::atomic_flag frame_lock = ATOMIC_FLAG_INIT;
+    std::atomic<bool> view_changing;
+    void lockFrame() {
+        while (frame_lock.test_and_set(std::memory_order_acquire)) {
+        }
+    }
+    void unlockFrame() { frame_lock.clear(std::memory_order_release); }
+
+    // Position in the store of screen pixel (0, 0)
+    int origin_x;
+    int origin_y;
+
+    // For 0 <= i < 2 * size
+    static int wrap(int i, int size) { return i < size ? i : i - size; }
+    int storageX(int x) const { return wrap(x + origin_x, screen_w); }
+    int storageY(int y) const { return wrap(y + origin_y, screen_h); }
+
+    void countPixel(const PixelState& pixel, int delta)
+    {
+        if (pixel.iteration != PixelState::INTERIOR) {
+            histogram[histogramBucket(pixel.iteration)].fetch_add(static_cast<uint32_t>(delta), std::memory_order_relaxed);
+        }
+    }
+    void clearHistogram();
+    // Set or clear the bits of x1 to x2 of row y, the span may wrap around the end of the store row. Counted
+    // keeps the histogram in step, pixels whose bit flips are added or removed
+    void fillCompleteBits(int y, int x1, int x2, bool complete, bool counted);
+    void fillComplete(int x1, int y1, int x2, int y2, bool complete);
 };
 
 #endif // FRACTALIS_STATE_H
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "MarianiSilver.hpp"
+#include "globals.h"
+#include "stats.h"
+#include <cstdio>
+
+MarianiSilver::MarianiSilver(FractalisState* state, Fractalis* fractalis)
+    : state(state), fractalis(fractalis) {
+    // Depth first, the stack holds one pending half per split level
+    stack.reserve(64);
+}
+
+bool MarianiSilver::render(int iter_limit, uint8_t calculation_id) {
+    stack.clear();
+    stack.push_back({0, 0, static_cast<int16_t>(state->screen_w - 1), static_cast<int16_t>(state->screen_h - 1)});
+    int filled = 0;
+
+    while (!stack.empty()) {
+        Rect rect = stack.back();
+        stack.pop_back();
+
+        calculate_border(rect, iter_limit);
+        bool has_inside = rect.x2 - rect.x1 >= 2 && rect.y2 - rect.y1 >= 2;
+        if (!has_inside) {
+            publish(rect);
+        } else {
+            if (border_uniform(rect)) {
+                fill(rect);
+                publish(rect);
+                filled++;
+            } else if (rect.x2 - rect.x1 <= MIN_SIZE || rect.y2 - rect.y1 <= MIN_SIZE) {
+                fractalis->calculate_tile(rect.x1 + 1, rect.y1 + 1, rect.x2 - 1, rect.y2 - 1, iter_limit);
+                publish(rect);
+            } else if (rect.x2 - rect.x1 >= rect.y2 - rect.y1) {
+                // Both halves share the split column, it is calculated once as the border of the first
+                int16_t mid = (rect.x1 + rect.x2) / 2;
+                stack.push_back({mid, rect.y1, rect.x2, rect.y2});
+                stack.push_back({rect.x1, rect.y1, mid, rect.y2});
+            } else {
+                int16_t mid = (rect.y1 + rect.y2) / 2;
+                stack.push_back({rect.x1, mid, rect.x2, rect.y2});
+                stack.push_back({rect.x1, rect.y1, rect.x2, mid});
+            }
+        }
+
+        if (state->calculation_id != calculation_id) {
+            printf("Mariani-Silver: interrupted, resetting %d,%d - %d,%d\n", rect.x1, rect.y1, rect.x2, rect.y2);
+            state->resetPixelComplete(rect.x1, rect.y1, rect.x2, rect.y2);
+            stats::count(stats::INTERRUPTED_PASSES);
+            return false;
+        }
+    }
+
+    printf("Mariani-Silver: %d rectangles filled\n", filled);
+    return true;
+}
+
+void MarianiSilver::calculate_border(const Rect& rect, int iter_limit) {
+    fractalis->calculate_row(rect.y1, rect.x1, rect.x2, iter_limit);
+    fractalis->calculate_row(rect.y2, rect.x1, rect.x2, iter_limit);
+    fractalis->calculate_tile(rect.x1, rect.y1 + 1, rect.x1, rect.y2 - 1, iter_limit);
+    fractalis->calculate_tile(rect.x2, rect.y1 + 1, rect.x2, rect.y2 - 1, iter_limit);
+}
+
+// Pixels the kernel left incomplete, e.g. perturbation glitches, make a border non uniform
+bool MarianiSilver::border_uniform(const Rect& rect) {
+    if (state->nextIncompletePixel(rect.y1, rect.x1, rect.x2) <= rect.x2 ||
+        state->nextIncompletePixel(rect.y2, rect.x1, rect.x2) <= rect.x2) {
+        return false;
+    }
+    for (int y = rect.y1 + 1; y < rect.y2; ++y) {
+        if (!state->isPixelComplete(rect.x1, y) || !state->isPixelComplete(rect.x2, y)) {
+            return false;
+        }
+    }
+    const uint16_t iteration = state->at(rect.x1, rect.y1).iteration;
+
+    for (int x = rect.x1; x <= rect.x2; ++x) {
+        if (state->at(x, rect.y1).iteration != iteration || state->at(x, rect.y2).iteration != iteration) {
+            return false;
+        }
+    }
+    for (int y = rect.y1 + 1; y < rect.y2; ++y) {
+        if (state->at(rect.x1, y).iteration != iteration || state->at(rect.x2, y).iteration != iteration) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The halves of a split rectangle cover it including its border, so only rectangles that are done are published
+void MarianiSilver::publish(const Rect& rect) {
+    state->finished[CORE1].push({rect.x1, rect.y1, rect.x2, rect.y2});
+}
+
+// The smooth iteration still varies inside an escape band. It is interpolated between the opposite borders,
+// horizontally and vertically, and the two are averaged
+void MarianiSilver::fill(const Rect& rect) {
+    const uint16_t iteration = state->at(rect.x1, rect.y1).iteration;
+    const int width = rect.x2 - rect.x1;
+    const int height = rect.y2 - rect.y1;
+
+    for (int y = rect.y1 + 1; y < rect.y2; ++y) {
+        const int left = state->at(rect.x1, y).smooth_iteration;
+        const int right = state->at(rect.x2, y).smooth_iteration;
+        for (int x = rect.x1 + 1; x < rect.x2; ++x) {
+            // Pixels kept from the frame before are exact, and counted in the histogram as they are
+            if (state->isPixelComplete(x, y)) {
+                continue;
+            }
+            const int top = state->at(x, rect.y1).smooth_iteration;
+            const int bottom = state->at(x, rect.y2).smooth_iteration;
+            int horizontal = (left * (rect.x2 - x) + right * (x - rect.x1)) / width;
+            int vertical = (top * (rect.y2 - y) + bottom * (y - rect.y1)) / height;
+
+            PixelState& pixel = state->at(x, y);
+            pixel.smooth_iteration = static_cast<uint16_t>((horizontal + vertical) / 2);
+            pixel.iteration = iteration;
+        }
+    }
+    state->setPixelComplete(rect.x1 + 1, rect.y1 + 1, rect.x2 - 1, rect.y2 - 1);
+}
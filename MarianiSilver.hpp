@@ -0,0 +1,43 @@
+#ifndef MARIANI_SILVER_H
+#define MARIANI_SILVER_H
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Mariani-Silver renderer. Calculates the border of a rectangle first. If every border pixel has the
+ * same iteration count, the Mandelbrot set being connected means the inside has it as well, so it is
+ * filled without iterating. Otherwise the rectangle is split in two and both halves are handled the same way.
+ */
+class MarianiSilver {
+public:
+    MarianiSilver(FractalisState* state, Fractalis* fractalis);
+
+    /**
+     * @brief Calculate the whole screen into the pixels of state. Fractalis::begin_frame() has to be called before.
+     * @return false if the calculation was interrupted by a new calculation id. The rectangle that was in
+     * progress is reset then, everything completed before it stays.
+     */
+    bool render(int iter_limit, uint8_t calculation_id);
+
+private:
+    struct Rect {
+        int16_t x1, y1, x2, y2;
+    };
+
+    FractalisState* state;
+    Fractalis* fractalis;
+    std::vector<Rect> stack;
+
+    // Rectangles with a side up to this many pixels are calculated directly, splitting them saves nothing
+    static constexpr int MIN_SIZE = 6;
+
+    void calculate_border(const Rect& rect, int iter_limit);
+    bool border_uniform(const Rect& rect);
+    void fill(const Rect& rect);
+    void publish(const Rect& rect);
+};
+
+#endif // MARIANI_SILVER_H
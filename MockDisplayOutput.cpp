@@ -0,0 +1,24 @@
+#include "MockDisplayOutput.hpp"
+
+MockDisplayOutput::MockDisplayOutput(int screen_w, int screen_h)
+    : screen_w(screen_w), screen_h(screen_h), total_bytes(0), frame_count(0) {
+}
+
+void MockDisplayOutput::update() {
+    update({0, 0, static_cast<int16_t>(screen_w - 1), static_cast<int16_t>(screen_h - 1)});
+}
+
+void MockDisplayOutput::update(const ScreenRect& rect) {
+    rects.push_back(rect);
+    total_bytes += WINDOW_BYTES + static_cast<uint64_t>(rect.x2 - rect.x1 + 1) * (rect.y2 - rect.y1 + 1) * BYTES_PER_PIXEL;
+}
+
+uint64_t MockDisplayOutput::full_update_bytes() const {
+    return frame_count * (WINDOW_BYTES + static_cast<uint64_t>(screen_w) * screen_h * BYTES_PER_PIXEL);
+}
+
+void MockDisplayOutput::reset() {
+    rects.clear();
+    total_bytes = 0;
+    frame_count = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef MOCK_DISPLAY_OUTPUT_H
+#define MOCK_DISPLAY_OUTPUT_H
+
+#include "DisplayOutput.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Display output for the host. Nothing is sent, the transfers are recorded instead: their rectangles and the
+ * bytes the ST7789 would have received over SPI, to measure what partial updates save.
+ */
+class MockDisplayOutput : public DisplayOutput {
+public:
+    MockDisplayOutput(int screen_w, int screen_h);
+
+    void update() override;
+    void update(const ScreenRect& rect) override;
+    void end_frame() override { frame_count++; }
+
+    /** @brief Rectangles sent since the last reset(), a full update as the whole screen. */
+    const std::vector<ScreenRect>& transfers() const { return rects; }
+    uint64_t bytes() const { return total_bytes; }
+    int frames() const { return frame_count; }
+    /** @brief What the same frames would have cost as full updates. */
+    uint64_t full_update_bytes() const;
+    void reset();
+
+private:
+    int screen_w;
+    int screen_h;
+    std::vector<ScreenRect> rects;
+    uint64_t total_bytes;
+    int frame_count;
+};
+
+#endif // MOCK_DISPLAY_OUTPUT_H
@@ -0,0 +1,91 @@
+#include "Progressive.hpp"
+#include "globals.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstdio>
+
+Progressive::Progressive(FractalisState* state, Fractalis* fractalis, TileScheduler* scheduler)
+    : state(state), fractalis(fractalis), scheduler(scheduler), step(COARSEST), iter_limit(0), spans(1) {
+}
+
+bool Progressive::render(int iter_limit, uint8_t calculation_id) {
+    this->iter_limit = iter_limit;
+    spans = (state->screen_w + SPAN - 1) / SPAN;
+    for (step = COARSEST; step >= 1; step /= 2) {
+        if (!scheduler->run(*this, (state->screen_h + step - 1) / step * spans, calculation_id)) {
+            printf("Progressive: interrupted in pass %d\n", step);
+            stats::count(stats::INTERRUPTED_PASSES);
+            return false;
+        }
+        printf("Progressive: pass %d complete\n", step);
+    }
+    return true;
+}
+
+void Progressive::calculate_tile(int tile, CORE core) {
+    const int y = tile / spans * step;
+    int x_start, x_step;
+    row_pixels(y, x_start, x_step);
+    int segments[2][2];
+    const int count = span_segments(tile, segments);
+    for (int i = 0; i < count; ++i) {
+        const int x1 = segments[i][0];
+        const int x2 = segments[i][1];
+        fractalis->calculate_row(y, first_pixel(x1, x_start, x_step), x2, iter_limit, x_step);
+        // With the blocks of its last pixels, which reach into the next segment
+        state->finished[core].push({static_cast<int16_t>(x1), static_cast<int16_t>(y),
+                                    static_cast<int16_t>(std::min(x2 | (step - 1), state->screen_w - 1)),
+                                    static_cast<int16_t>(std::min(y + step, state->screen_h) - 1)});
+    }
+}
+
+void Progressive::reset_tile(int tile) {
+    const int y = tile / spans * step;
+    int x_start, x_step;
+    row_pixels(y, x_start, x_step);
+    int segments[2][2];
+    const int count = span_segments(tile, segments);
+    for (int i = 0; i < count; ++i) {
+        for (int x = first_pixel(segments[i][0], x_start, x_step); x <= segments[i][1]; x += x_step) {
+            state->resetPixelComplete(x, y, x, y);
+        }
+    }
+}
+
+int Progressive::first_pixel(int x1, int x_start, int x_step) {
+    return x1 <= x_start ? x_start : x_start + (x1 - x_start + x_step - 1) / x_step * x_step;
+}
+
+int Progressive::span_segments(int tile, int segments[2][2]) const {
+    const int storage_x = tile % spans * SPAN;
+    const int x1 = state->screenColumn(storage_x);
+    const int x2 = state->screenColumn(std::min(storage_x + SPAN, state->screen_w) - 1);
+    if (x1 <= x2) {
+        segments[0][0] = x1;
+        segments[0][1] = x2;
+        return 1;
+    }
+    segments[0][0] = x1;
+    segments[0][1] = state->screen_w - 1;
+    segments[1][0] = 0;
+    segments[1][1] = x2;
+    return 2;
+}
+
+// Rows of the previous pass already have every other pixel of this one
+void Progressive::row_pixels(int y, int& x_start, int& x_step) const {
+    bool previous_row = step < COARSEST && y % (2 * step) == 0;
+    x_start = previous_row ? step : 0;
+    x_step = previous_row ? 2 * step : step;
+}
+
+const PixelState* Progressive::block_sample(const FractalisState& state, int x, int y) {
+    for (int step = 2; step <= COARSEST; step *= 2) {
+        const int sample_x = x & ~(step - 1);
+        const int sample_y = y & ~(step - 1);
+        if (state.isPixelComplete(sample_x, sample_y)) {
+            return &state.at(sample_x, sample_y);
+        }
+    }
+    return nullptr;
+}
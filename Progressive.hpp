@@ -0,0 +1,67 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include "TileScheduler.hpp"
+#include <cstdint>
+
+/**
+ * Progressive renderer. Calculates every COARSEST-th pixel of every COARSEST-th row first, then halves
+ * the spacing until every pixel is calculated. Each pass only calculates the pixels that are not on the
+ * grid of the pass before, so no pixel is calculated twice. Until a pixel is calculated, the renderer
+ * draws it with the color of the grid sample of its block, see block_sample().
+ * Every row of a pass is cut into spans of SPAN store columns, these are the tiles of a TileScheduler job and
+ * both cores calculate them. A span is short enough that core0 gets back to its input and display in time at
+ * deep zooms, where a whole row takes hundreds of ms. A finished span is published with the rows below it that
+ * its blocks cover.
+ */
+class Progressive : public TileJob {
+public:
+    // Spacing of the first pass, a power of two
+    static constexpr int COARSEST = 8;
+    // Width of a tile in store columns, whole words of the completion bitmap
+    static constexpr int SPAN = 64;
+
+    Progressive(FractalisState* state, Fractalis* fractalis, TileScheduler* scheduler);
+
+    /**
+     * @brief Calculate the whole screen into the pixels of state. Fractalis::begin_frame() has to be called before.
+     * @return false if the calculation was interrupted by a new calculation id. The pixels of the rows that
+     * were in progress are reset then, everything completed before stays.
+     */
+    bool render(int iter_limit, uint8_t calculation_id);
+
+    /**
+     * @brief The finest completed grid sample whose block covers pixel (x, y), nullptr if there is none yet.
+     * The pixel itself is not considered.
+     */
+    static const PixelState* block_sample(const FractalisState& state, int x, int y);
+
+    // Span tile % spans of row tile / spans * step of the current pass
+    void calculate_tile(int tile, CORE core) override;
+    void reset_tile(int tile) override;
+
+private:
+    FractalisState* state;
+    Fractalis* fractalis;
+    TileScheduler* scheduler;
+    // Pass in progress
+    int step;
+    int iter_limit;
+    // Spans per row
+    int spans;
+
+    // Pixels of row y calculated in the current pass, x_start, x_start + x_step, ...
+    void row_pixels(int y, int& x_start, int& x_step) const;
+    // The first of x_start, x_start + x_step, ... that is not left of x1
+    static int first_pixel(int x1, int x_start, int x_step);
+    /**
+     * @brief Screen columns of the span of a tile, segments[i] is {x1, x2}. A span the screen edge cuts
+     * has two segments.
+     * @return the number of segments.
+     */
+    int span_segments(int tile, int segments[2][2]) const;
+};
+
+#endif // PROGRESSIVE_H
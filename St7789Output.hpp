@@ -0,0 +1,24 @@
+#ifndef ST7789_OUTPUT_H
+#define ST7789_OUTPUT_H
+
+#include "DisplayOutput.hpp"
+#include "drivers/st7789/st7789.hpp"
+#include "libraries/pico_graphics/pico_graphics.hpp"
+
+// The display pack's ST7789, partial updates set the column and row window and send only its pixels
+class St7789Output : public DisplayOutput {
+public:
+    St7789Output(pimoroni::ST7789& st7789, pimoroni::PicoGraphics& graphics) : st7789(st7789), graphics(graphics) {}
+
+    void update() override { st7789.update(&graphics); }
+    void update(const ScreenRect& rect) override
+    {
+        st7789.partial_update(&graphics, pimoroni::Rect(rect.x1, rect.y1, rect.x2 - rect.x1 + 1, rect.y2 - rect.y1 + 1));
+    }
+
+private:
+    pimoroni::ST7789& st7789;
+    pimoroni::PicoGraphics& graphics;
+};
+
+#endif // ST7789_OUTPUT_H
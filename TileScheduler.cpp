@@ -0,0 +1,75 @@
+#include "TileScheduler.hpp"
+
+TileScheduler::TileScheduler(FractalisState* state)
+    : state(state), pending(0), job(nullptr), helping(false), calculation_id(0) {
+    queues[CORE0].store(0);
+    queues[CORE1].store(0);
+}
+
+bool TileScheduler::run(TileJob& job, int count, uint8_t calculation_id) {
+    this->calculation_id = calculation_id;
+    pending.store(count, std::memory_order_relaxed);
+    queues[CORE1].store(pack(0, count / 2), std::memory_order_relaxed);
+    queues[CORE0].store(pack(count / 2, count), std::memory_order_relaxed);
+    // Publishes the queues and everything core1 prepared for the frame, e.g. the kernels of its tier
+    this->job.store(&job, std::memory_order_release);
+
+    int tile;
+    while (take(CORE1, tile)) {
+        process(job, tile, CORE1);
+    }
+    // The last tiles may still be in progress on core0
+    while (pending.load(std::memory_order_acquire) > 0) {
+    }
+
+    // A core0 that saw the job before it ended has to leave help() before the next job replaces the queues.
+    // Sequentially consistent, so core0 either sees no job or is seen helping
+    this->job.store(nullptr);
+    while (helping.load()) {
+    }
+    return state->calculation_id == calculation_id;
+}
+
+bool TileScheduler::help() {
+    helping.store(true);
+    TileJob* current = job.load();
+    int tile;
+    const bool found = current != nullptr && take(CORE0, tile);
+    if (found) {
+        process(*current, tile, CORE0);
+    }
+    helping.store(false);
+    return found;
+}
+
+bool TileScheduler::take(CORE core, int& tile) {
+    // Own queue from the front
+    uint32_t range = queues[core].load(std::memory_order_relaxed);
+    while ((range >> 16) < (range & 0xFFFF)) {
+        if (queues[core].compare_exchange_weak(range, range + (1u << 16), std::memory_order_relaxed)) {
+            tile = static_cast<int>(range >> 16);
+            return true;
+        }
+    }
+    // The other core's queue from the back, where its owner is the furthest away
+    std::atomic<uint32_t>& other = queues[core ^ 1];
+    range = other.load(std::memory_order_relaxed);
+    while ((range >> 16) < (range & 0xFFFF)) {
+        if (other.compare_exchange_weak(range, range - 1, std::memory_order_relaxed)) {
+            tile = static_cast<int>(range & 0xFFFF) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tiles taken after the calculation id changed are dropped, one that was in progress is reset
+void TileScheduler::process(TileJob& job, int tile, CORE core) {
+    if (state->calculation_id == calculation_id) {
+        job.calculate_tile(tile, core);
+        if (state->calculation_id != calculation_id) {
+            job.reset_tile(tile);
+        }
+    }
+    pending.fetch_sub(1, std::memory_order_release);
+}
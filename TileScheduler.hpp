@@ -0,0 +1,65 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include "FractalisState.h"
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Work that TileScheduler shares between the cores: tiles 0 to count - 1, calculated in any order and on
+ * either core. Tiles are made of whole words of the completion bitmap, so two cores never write the same word.
+ */
+class TileJob {
+public:
+    /** @brief Calculate a tile on core, which publishes the finished pixels to its queue in FractalisState::finished. */
+    virtual void calculate_tile(int tile, CORE core) = 0;
+    /** @brief Reset the pixels of a tile that was in progress when the calculation id changed. */
+    virtual void reset_tile(int tile) = 0;
+
+protected:
+    ~TileJob() = default;
+};
+
+/**
+ * Calculates the tiles of a job on both cores. Every core has a queue of tiles, each starts with half of them.
+ * A core takes tiles from the front of its own queue and steals from the back of the other one once its own
+ * is empty. Both ends of a queue are packed into one atomic word, taking and stealing are a compare and swap.
+ *
+ * Core1 runs a job and returns once every tile is done. Core0 helps between its input and display ticks.
+ */
+class TileScheduler {
+public:
+    TileScheduler(FractalisState* state);
+
+    /**
+     * @brief Calculate the tiles 0 to count - 1 of job on both cores. Called by core1, returns once no tile is in
+     * progress on either core anymore.
+     * @return false if the calculation was interrupted by a new calculation id. Tiles that were in progress then
+     * are reset, everything completed before stays.
+     */
+    bool run(TileJob& job, int count, uint8_t calculation_id);
+
+    /**
+     * @brief Calculate one tile of the job core1 is running, called by core0.
+     * @return false if there is no job or no tile left.
+     */
+    bool help();
+
+private:
+    FractalisState* state;
+    // front << 16 | back, the tiles front to back - 1 are queued
+    std::atomic<uint32_t> queues[2];
+    // Tiles not done yet, including the ones in progress
+    std::atomic<int> pending;
+    std::atomic<TileJob*> job;
+    // Core0 is in help(), a job is only ended when it isn't
+    std::atomic<bool> helping;
+    uint8_t calculation_id;
+
+    static uint32_t pack(int front, int back) { return static_cast<uint32_t>(front) << 16 | static_cast<uint32_t>(back); }
+
+    bool take(CORE core, int& tile);
+    void process(TileJob& job, int tile, CORE core);
+};
+
+#endif // TILE_SCHEDULER_H
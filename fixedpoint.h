@@ -0,0 +1,123 @@
+//
+// Fixed point numbers for the escape time kernel.
+//
+// Both formats have 1 sign bit and 3 integer bits, so they hold |x| < 8. The kernel never needs more:
+// while |z| <= 2 and |c| < 4, neither z^2 + c nor the squares of its components leave that range.
+// Unlike floating point their resolution is absolute, independent of the magnitude of the coordinates.
+//
+// Fixed32: Q3.28 in an int32_t, multiplied with a 64 bit intermediate. Resolution 3.7e-9.
+// Fixed64: Q3.60 in an int64_t, multiplied with a 128 bit intermediate. Resolution 8.7e-19.
+//
+// On the RP2040, which has no FPU, these are a few integer instructions per operation
+// instead of a soft float library call.
+//
+
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <cstdint>
+#include <cmath>
+#include "doubledouble.h"
+
+namespace fixedpoint {
+
+// (a * b) >> shift for 0 < shift < 64 and |a|, |b| < 2^63
+inline int64_t mul_shift(int64_t a, int64_t b, int shift)
+{
+#ifdef __SIZEOF_INT128__
+    return static_cast<int64_t>((static_cast<__int128>(a) * b) >> shift);
+#else
+    // 32 bit targets have no __int128, assemble the 128 bit product from 32x32->64 bit multiplies
+    bool negative = (a < 0) != (b < 0);
+    uint64_t ua = a < 0 ? -static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+    uint64_t ub = b < 0 ? -static_cast<uint64_t>(b) : static_cast<uint64_t>(b);
+
+    uint64_t a_lo = static_cast<uint32_t>(ua), a_hi = ua >> 32;
+    uint64_t b_lo = static_cast<uint32_t>(ub), b_hi = ub >> 32;
+    uint64_t ll = a_lo * b_lo;
+    uint64_t lh = a_lo * b_hi;
+    uint64_t hl = a_hi * b_lo;
+    uint64_t hh = a_hi * b_hi;
+
+    uint64_t mid = (ll >> 32) + static_cast<uint32_t>(lh) + static_cast<uint32_t>(hl);
+    uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    uint64_t lo = (mid << 32) | static_cast<uint32_t>(ll);
+
+    uint64_t result = (hi << (64 - shift)) | (lo >> shift);
+    return negative ? -static_cast<int64_t>(result) : static_cast<int64_t>(result);
+#endif
+}
+
+template <typename Raw, typename Wide, int FRACTION_BITS>
+class Fixed
+{
+public:
+    static constexpr int fraction_bits = FRACTION_BITS;
+    // Smallest representable step
+    static constexpr double epsilon = 1.0 / static_cast<double>(static_cast<Wide>(1) << FRACTION_BITS);
+
+    Raw raw{0};
+
+    constexpr
+    Fixed() {}
+
+    static constexpr Fixed from_raw(Raw raw)
+    {
+        Fixed x;
+        x.raw = raw;
+        return x;
+    }
+
+    static constexpr Fixed from_int(int x)
+    {
+        return from_raw(static_cast<Raw>(x) << FRACTION_BITS);
+    }
+
+    double to_double() const
+    {
+        return static_cast<double>(raw) * epsilon;
+    }
+
+    Fixed operator-() const { return from_raw(-raw); }
+    Fixed operator+(const Fixed& x) const { return from_raw(raw + x.raw); }
+    Fixed operator-(const Fixed& x) const { return from_raw(raw - x.raw); }
+    Fixed operator*(const Fixed& x) const;
+
+    bool operator==(const Fixed& x) const { return raw == x.raw; }
+    bool operator!=(const Fixed& x) const { return raw != x.raw; }
+    bool operator<(const Fixed& x) const { return raw < x.raw; }
+    bool operator<=(const Fixed& x) const { return raw <= x.raw; }
+    bool operator>(const Fixed& x) const { return raw > x.raw; }
+    bool operator>=(const Fixed& x) const { return raw >= x.raw; }
+};
+
+using Fixed32 = Fixed<int32_t, int64_t, 28>;
+using Fixed64 = Fixed<int64_t, int64_t, 60>;
+
+template <>
+inline Fixed32 Fixed32::operator*(const Fixed32& x) const
+{
+    return from_raw(static_cast<int32_t>((static_cast<int64_t>(raw) * x.raw) >> fraction_bits));
+}
+
+template <>
+inline Fixed64 Fixed64::operator*(const Fixed64& x) const
+{
+    return from_raw(mul_shift(raw, x.raw, fraction_bits));
+}
+
+// Exact to one unit in the last place, the DoubleDouble may carry more bits than Q3.60 can hold
+inline Fixed64 fixed64_from_dd(const doubledouble::DoubleDouble& x)
+{
+    const double scale = static_cast<double>(static_cast<int64_t>(1) << Fixed64::fraction_bits);
+    return Fixed64::from_raw(llround(x.upper * scale) + llround(x.lower * scale));
+}
+
+inline Fixed32 fixed32_from_fixed64(const Fixed64& x)
+{
+    return Fixed32::from_raw(static_cast<int32_t>(x.raw >> (Fixed64::fraction_bits - Fixed32::fraction_bits)));
+}
+
+} // namespace
+
+#endif
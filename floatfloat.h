@@ -0,0 +1,231 @@
+//
+// A float-float class, the single precision counterpart of doubledouble.h.
+//
+// A FloatFloat is the unevaluated sum of two floats, upper + lower with |lower| <= ulp(upper)/2,
+// built from the same error free two_sum/two_product transformations as DoubleDouble.
+// That gives about 48 bits of mantissa using nothing but single precision instructions,
+// which the RP2350's Cortex-M33 executes natively, while double is emulated.
+//
+// Only what the escape time kernel needs is implemented: +, -, * and comparisons.
+//
+
+#ifndef FLOATFLOAT_H
+#define FLOATFLOAT_H
+
+#include <cmath>
+#include <cfloat>
+#include "doubledouble.h"
+
+namespace floatfloat {
+
+class FloatFloat
+{
+public:
+
+    float upper{0.0f};
+    float lower{0.0f};
+
+    constexpr
+    FloatFloat() {}
+
+    constexpr
+    FloatFloat(float upper, float lower) : upper(upper), lower(lower) {}
+
+    constexpr
+    FloatFloat(float upper) : upper(upper) {}
+
+    // Keeps the upper 48 of the 53 bits of a double
+    FloatFloat(double x)
+    {
+        upper = static_cast<float>(x);
+        lower = static_cast<float>(x - upper);
+    }
+
+    FloatFloat(const doubledouble::DoubleDouble& x)
+    {
+        upper = static_cast<float>(x.upper);
+        lower = static_cast<float>((x.upper - upper) + x.lower);
+    }
+
+    double to_double() const
+    {
+        return static_cast<double>(upper) + static_cast<double>(lower);
+    }
+
+    FloatFloat operator-() const;
+    FloatFloat operator+(float x) const;
+    FloatFloat operator+(const FloatFloat& x) const;
+    FloatFloat operator-(float x) const;
+    FloatFloat operator-(const FloatFloat& x) const;
+    FloatFloat operator*(float x) const;
+    FloatFloat operator*(const FloatFloat& x) const;
+
+    bool operator==(const FloatFloat& x) const;
+    bool operator!=(const FloatFloat& x) const;
+    bool operator<(float x) const;
+    bool operator<(const FloatFloat& x) const;
+    bool operator<=(float x) const;
+    bool operator<=(const FloatFloat& x) const;
+    bool operator>(float x) const;
+    bool operator>(const FloatFloat& x) const;
+    bool operator>=(float x) const;
+    bool operator>=(const FloatFloat& x) const;
+};
+
+
+inline FloatFloat two_sum_quick(float x, float y)
+{
+    float r = x + y;
+    float e = y - (r - x);
+    return FloatFloat(r, e);
+}
+
+
+inline FloatFloat two_sum(float x, float y)
+{
+    float r = x + y;
+    float t = r - x;
+    float e = (x - (r - t)) + (y - t);
+    return FloatFloat(r, e);
+}
+
+
+inline FloatFloat two_difference(float x, float y)
+{
+    float r = x - y;
+    float t = r - x;
+    float e = (x - (r - t)) - (y + t);
+    return FloatFloat(r, e);
+}
+
+
+inline FloatFloat two_product(float x, float y)
+{
+    float r = x*y;
+#ifdef FP_FAST_FMAF
+    float e = fmaf(x, y, -r);
+#else
+    // Without a hardware fma, fmaf is a slow library call. Use Dekker's product with Veltkamp's split
+    const float split = 4097.0f;  // 2^12 + 1
+    float xs = split*x;
+    float xh = xs - (xs - x);
+    float xl = x - xh;
+    float ys = split*y;
+    float yh = ys - (ys - y);
+    float yl = y - yh;
+    float e = ((xh*yh - r) + xh*yl + xl*yh) + xl*yl;
+#endif
+    return FloatFloat(r, e);
+}
+
+
+inline FloatFloat FloatFloat::operator-() const
+{
+    return FloatFloat(-upper, -lower);
+}
+
+inline FloatFloat FloatFloat::operator+(float x) const
+{
+    FloatFloat re = two_sum(upper, x);
+    re.lower += lower;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline FloatFloat operator+(float x, const FloatFloat& y)
+{
+    return y + x;
+}
+
+inline FloatFloat FloatFloat::operator+(const FloatFloat& x) const
+{
+    FloatFloat re = two_sum(upper, x.upper);
+    re.lower += lower + x.lower;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline FloatFloat FloatFloat::operator-(float x) const
+{
+    FloatFloat re = two_difference(upper, x);
+    re.lower += lower;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline FloatFloat FloatFloat::operator-(const FloatFloat& x) const
+{
+    FloatFloat re = two_difference(upper, x.upper);
+    re.lower += lower - x.lower;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline FloatFloat FloatFloat::operator*(float x) const
+{
+    FloatFloat re = two_product(upper, x);
+    re.lower += lower * x;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline FloatFloat operator*(float x, const FloatFloat& y)
+{
+    return y * x;
+}
+
+inline FloatFloat FloatFloat::operator*(const FloatFloat& x) const
+{
+    FloatFloat re = two_product(upper, x.upper);
+    re.lower += upper*x.lower + lower*x.upper;
+    return two_sum_quick(re.upper, re.lower);
+}
+
+inline bool FloatFloat::operator==(const FloatFloat& x) const
+{
+    return (upper == x.upper) && (lower == x.lower);
+}
+
+inline bool FloatFloat::operator!=(const FloatFloat& x) const
+{
+    return (upper != x.upper) || (lower != x.lower);
+}
+
+inline bool FloatFloat::operator<(float x) const
+{
+    return (upper < x) || ((upper == x) && (lower < 0.0f));
+}
+
+inline bool FloatFloat::operator<(const FloatFloat& x) const
+{
+    return (upper < x.upper) || ((upper == x.upper) && (lower < x.lower));
+}
+
+inline bool FloatFloat::operator<=(float x) const
+{
+    return (upper < x) || ((upper == x) && (lower <= 0.0f));
+}
+
+inline bool FloatFloat::operator<=(const FloatFloat& x) const
+{
+    return (upper < x.upper) || ((upper == x.upper) && (lower <= x.lower));
+}
+
+inline bool FloatFloat::operator>(float x) const
+{
+    return (upper > x) || ((upper == x) && (lower > 0.0f));
+}
+
+inline bool FloatFloat::operator>(const FloatFloat& x) const
+{
+    return (upper > x.upper) || ((upper == x.upper) && (lower > x.lower));
+}
+
+inline bool FloatFloat::operator>=(float x) const
+{
+    return (upper > x) || ((upper == x) && (lower >= 0.0f));
+}
+
+inline bool FloatFloat::operator>=(const FloatFloat& x) const
+{
+    return (upper > x.upper) || ((upper == x.upper) && (lower >= x.lower));
+}
+
+} // namespace
+
+#endif
@@ -1,154 +1,645 @@
 #include "fractalis.h"
 #include "globals.h"
+#include "stats.h"
 #include <cmath>
-
-Fractalis::Fractalis(FractalisState* state) : state(state) {}
-
-std::complex<DoubleDouble> Fractalis::f_c(const std::complex<DoubleDouble>& c, const std::complex<DoubleDouble>& z) {
-    return z * z + c;
+#include <cfloat>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+Fractalis::Fractalis(FractalisState* state)
+    : state(state), perturbation(state, &orbit_pool), tier(PrecisionTier::DOUBLE), tier_forced(false), forced_tier(PrecisionTier::DOUBLE),
+      geometry(), pixel_kernel(nullptr), batch_kernel(nullptr), tile_kernel(nullptr), sample_kernel(nullptr),
+      frame_calculation_id(0) {}
+
+double Fractalis::pixel_spacing() {
+    return 4.0 / state->zoom_factor / state->screen_w;
 }
 
-std::complex<double> Fractalis::pixel_to_point_double(int x, int y) {
-    double x_percent = static_cast<double>(x) / state->screen_w;
-    double y_percent = static_cast<double>(y) / state->screen_h;
-    
-    
+// Largest coordinate magnitude on screen
+double Fractalis::view_magnitude() {
     double x_range = 4.0 / state->zoom_factor;
     double y_range = x_range / state->ASPECT_RATIO;
-    
-    double re = state->center.real.upper + (x_percent - 0.5) * x_range + state->pan_real.upper;
-    double im = state->center.imag.upper + (y_percent - 0.5) * y_range + state->pan_imag.upper;
-    
-    return std::complex<double>(re, im);
+    double re = state->center.real.upper + state->pan_real.upper;
+    double im = state->center.imag.upper + state->pan_imag.upper;
+    return std::max(std::abs(re) + x_range / 2, std::abs(im) + y_range / 2);
+}
+
+double Fractalis::spacing_in_ulps(double epsilon) {
+    return pixel_spacing() / (epsilon * view_magnitude());
 }
 
+// Floating point precision is relative, the ulp of the largest coordinate is the coarsest one we render with
+bool Fractalis::precisionSufficient(double epsilon) {
+    return spacing_in_ulps(epsilon) > ULP_MARGIN;
+}
 
-std::complex<DoubleDouble> Fractalis::pixel_to_point_dd(int x, int y) {
-    DoubleDouble x_percent = DoubleDouble(x) / DoubleDouble(state->screen_w);
-    DoubleDouble y_percent = DoubleDouble(y) / DoubleDouble(state->screen_h);
-    
-    DoubleDouble aspect_ratio = DoubleDouble(state->screen_w) / DoubleDouble(state->screen_h);
-    DoubleDouble x_range = DoubleDouble(4.0) / DoubleDouble(state->zoom_factor);
-    DoubleDouble y_range = x_range / aspect_ratio;
-    
-    DoubleDouble re = state->center.real + (x_percent - DoubleDouble(0.5)) * x_range + state->pan_real;
-    DoubleDouble im = state->center.imag + (y_percent - DoubleDouble(0.5)) * y_range + state->pan_imag;
-    
-    return std::complex<DoubleDouble>(re, im);
+PrecisionTier Fractalis::select_tier() {
+    if (tier_forced) {
+        return forced_tier;
+    }
+    // Fixed point precision is absolute. The format holds |x| < 8, which needs |c| < 4
+    if (USE_FIXED_POINT && view_magnitude() < 4.0) {
+        if (pixel_spacing() > ULP_MARGIN * Fixed32::epsilon) {
+            return PrecisionTier::FIXED32;
+        }
+        if (pixel_spacing() > ULP_MARGIN * Fixed64::epsilon) {
+            return PrecisionTier::FIXED64;
+        }
+    }
+    if (precisionSufficient(FLT_EPSILON)) {
+        return PrecisionTier::FLOAT;
+    }
+    if (USE_FLOAT_FLOAT && precisionSufficient(FLOAT_FLOAT_EPSILON)) {
+        return PrecisionTier::FLOAT_FLOAT;
+    }
+    if (precisionSufficient(DBL_EPSILON)) {
+        return PrecisionTier::DOUBLE;
+    }
+    // Pixels only differ in the low part of a DoubleDouble. Perturbation keeps the one reference orbit in it
+    // and iterates the differences to it, which double resolves at any depth
+    return PrecisionTier::PERTURBATION;
 }
 
-bool Fractalis::needsHighPrecision() {
-    // return state->zoom_factor > DoubleDouble(1e14);
-    return state->zoom_factor > 1e14;
+template <typename T>
+void Fractalis::select_kernels_for() {
+    using Deep = std::conditional_t<KernelNumber<T>::BOUNDED, DeepFixedPolicy, DeepPolicy>;
+    if (state->zoom_factor > 1e7) {
+        pixel_kernel = &Fractalis::calculate_pixel_kernel<T, Deep>;
+        batch_kernel = &Fractalis::calculate_pixels_kernel<T, Deep>;
+        tile_kernel = &Fractalis::calculate_tile_kernel<T, Deep>;
+        sample_kernel = &Fractalis::calculate_sample_kernel<T, Deep>;
+    } else {
+        pixel_kernel = &Fractalis::calculate_pixel_kernel<T, ShallowPolicy>;
+        batch_kernel = &Fractalis::calculate_pixels_kernel<T, ShallowPolicy>;
+        tile_kernel = &Fractalis::calculate_tile_kernel<T, ShallowPolicy>;
+        sample_kernel = &Fractalis::calculate_sample_kernel<T, ShallowPolicy>;
+    }
+    orbit_pool.begin_frame<T>(frame_calculation_id, static_cast<int>(tier));
 }
 
-bool Fractalis::approximately_equal(const std::complex<double>& a, const std::complex<double>& b, double epsilon) {
-    return std::abs(a - b) < epsilon;
+void Fractalis::select_kernels() {
+    switch (tier) {
+        case PrecisionTier::FLOAT:
+            select_kernels_for<float>();
+            break;
+        case PrecisionTier::FLOAT_FLOAT:
+            select_kernels_for<FloatFloat>();
+            break;
+        case PrecisionTier::FIXED32:
+            select_kernels_for<Fixed32>();
+            break;
+        case PrecisionTier::FIXED64:
+            select_kernels_for<Fixed64>();
+            break;
+        case PrecisionTier::DOUBLE:
+            select_kernels_for<double>();
+            break;
+        case PrecisionTier::DOUBLE_DOUBLE:
+            select_kernels_for<DoubleDouble>();
+            break;
+        case PrecisionTier::PERTURBATION:
+            pixel_kernel = &Fractalis::calculate_pixel_perturbation;
+            batch_kernel = &Fractalis::calculate_pixels_perturbation;
+            tile_kernel = &Fractalis::calculate_tile_perturbation;
+            sample_kernel = nullptr;
+            // Snapshots are the deltas to the reference
+            orbit_pool.begin_frame<double>(frame_calculation_id, static_cast<int>(tier));
+            break;
+    }
 }
 
-// Double precision implementation
-void Fractalis::calculate_pixel_double(int x, int y, int iter_limit) {
+namespace {
+
+// Pixel sources of the kernels, they only hand out pixels that are on screen. Once the calculation id differs
+// from the one of the frame they stop, the view is about to change
+
+struct PixelList {
+    const PixelCoord* pixels;
+    int count;
+    const FractalisState& state;
+    uint8_t calculation_id;
+    int next_index;
+
+    PixelList(const PixelCoord* pixels, int count, const FractalisState& state, uint8_t calculation_id)
+        : pixels(pixels), count(count), state(state), calculation_id(calculation_id), next_index(0) {}
+
+    bool next(int& x, int& y) {
+        if (state.calculation_id.load(std::memory_order_relaxed) != calculation_id) {
+            return false;
+        }
+        while (next_index < count) {
+            const PixelCoord& coord = pixels[next_index++];
+            if (coord.x >= 0 && coord.x < state.screen_w && coord.y >= 0 && coord.y < state.screen_h) {
+                x = coord.x;
+                y = coord.y;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Row by row, every x_step-th pixel of a row, clipped to the screen once. Without a step, runs of complete
+// pixels are skipped in the completion bitmap
+struct PixelRect {
+    const FractalisState& state;
+    uint8_t calculation_id;
+    int x1;
+    int x2;
+    int y2;
+    int x_step;
+    int x;
+    int y;
+
+    PixelRect(int x1, int y1, int x2, int y2, int x_step, const FractalisState& state, uint8_t calculation_id)
+        : state(state), calculation_id(calculation_id), x1(x1), x2(std::min(x2, state.screen_w - 1)), y2(std::min(y2, state.screen_h - 1)), x_step(x_step),
+          x(x1), y(std::max(y1, 0)) {
+        // The first pixel on screen that is on the step grid
+        if (x1 < 0) {
+            this->x1 = x = x1 + (-x1 + x_step - 1) / x_step * x_step;
+        }
+    }
+
+    bool next(int& px, int& py) {
+        if (state.calculation_id.load(std::memory_order_relaxed) != calculation_id) {
+            return false;
+        }
+        while (true) {
+            if (x > x2) {
+                x = x1;
+                y++;
+            }
+            if (y > y2 || x1 > x2) {
+                return false;
+            }
+            if (x_step > 1 || !state.isPixelComplete(x, y)) {
+                break;
+            }
+            x = state.nextIncompletePixel(y, x, x2);
+            if (x <= x2) {
+                break;
+            }
+        }
+        px = x;
+        py = y;
+        x += x_step;
+        return true;
+    }
+};
+
+} // namespace
+
+template <typename T, typename Policy>
+void Fractalis::calculate_pixel_kernel(int x, int y, int iter_limit) {
+    using Number = KernelNumber<T>;
+
     if (x < 0 || x >= state->screen_w || y < 0 || y >= state->screen_h) {
         return;
     }
-    if (state->pixelState[y][x].isComplete()) {
+    if (state->isPixelComplete(x, y)) {
         return;
     }
+    iterate_point<T, Policy>(state->at(x, y), Number::real(geometry, x - geometry.center_x),
+                             Number::imag(geometry, y - geometry.center_y), iter_limit, x, y);
+    state->setPixelComplete(x, y);
+}
 
-    std::complex<double> c = pixel_to_point_double(x, y);
+template <typename T, typename Policy>
+void Fractalis::calculate_pixels_kernel(const PixelCoord* pixels, int count, int iter_limit) {
+    PixelList source(pixels, count, *state, frame_calculation_id);
+    iterate_source<T, Policy>(source, iter_limit);
+}
+
+template <typename T, typename Policy>
+void Fractalis::calculate_tile_kernel(int x1, int y1, int x2, int y2, int x_step, int iter_limit) {
+    PixelRect source(x1, y1, x2, y2, x_step, *state, frame_calculation_id);
+    iterate_source<T, Policy>(source, iter_limit);
+}
+
+template <typename T, typename Policy>
+void Fractalis::calculate_sample_kernel(const FrameGeometry& frame, int x, int y, int iter_limit, PixelState& sample) {
+    using Number = KernelNumber<T>;
+    iterate_point<T, Policy>(sample, Number::real(frame, x - frame.center_x), Number::imag(frame, y - frame.center_y),
+                             iter_limit, -1, -1);
+}
 
-    bool skip_optimizations = state->zoom_factor > 1e7;
+// Components instead of std::complex, whose multiplication is a NaN checking library call.
+// x and y are the screen position for the orbit pool, x < 0 for points that are no pixel
+template <typename T, typename Policy>
+void Fractalis::iterate_point(PixelState& pixel, const T& cr, const T& ci, int iter_limit, int x, int y) {
+    using Number = KernelNumber<T>;
 
-    if (!skip_optimizations && is_in_main_bulb(c)) {
-        state->pixelState[y][x].iteration = iter_limit;
-        state->pixelState[y][x].setIsComplete(true);
+    if (Policy::BULB_CHECK && is_in_main_bulb(cr, ci)) {
+        complete_interior(pixel);
+        stats::count(stats::BULB_SKIPS);
         return;
     }
 
-    int iteration = 0;
-    std::complex<double> z(0, 0);
-    std::complex<double> z_old(0, 0);
-    uint8_t period = 0;
+    using D = typename Number::Derivative;
 
-    while (std::abs(z) <= 2.0 && iteration < iter_limit) {
-        z = z * z + c;
+    const T two = Number::dyadic(2, 0);
+    const T epsilon = Number::from_double(geometry.periodicity_epsilon);
+    const D interior_threshold = static_cast<D>(Policy::INTERIOR_THRESHOLD);
+    T zr{}, zi{};
+    T zr2{}, zi2{};
+    T old_zr{}, old_zi{};
+    D der_r = 1, der_i = 0;
+    int iteration = 0;
+    int next_save = 1;
+
+    // Continue an orbit that stopped at a lower limit
+    const int slot = x >= 0 ? orbit_pool.find<T>(x, y) : -1;
+    if (slot >= 0) {
+        double saved_der_r, saved_der_i;
+        orbit_pool.load(slot, iteration, zr, zi, saved_der_r, saved_der_i);
+        der_r = static_cast<D>(saved_der_r);
+        der_i = static_cast<D>(saved_der_i);
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+        old_zr = zr;
+        old_zi = zi;
+        while (next_save <= iteration) {
+            next_save <<= 1;
+        }
+    }
+    const int first_iteration = iteration;
+
+    bool interior = false;
+    // Not the same as iteration < iter_limit afterwards, an orbit can escape in the very last iteration
+    bool escaped = false;
+    while (iteration < iter_limit) {
+        zi = (zr + zr) * zi + ci;
+        zr = zr2 - zi2 + cr;
         iteration++;
 
-        // Periodicity checking
-        if (!skip_optimizations) {
-            if (approximately_equal(z, z_old)) {
-                iteration = iter_limit;
+        // Once a component exceeds 2, |z| > 2 and its square could overflow a bounded format
+        if (Number::BOUNDED && (zr > two || zr < -two || zi > two || zi < -two)) {
+            escaped = true;
+            break;
+        }
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+        if (Number::escaped(zr2, zi2)) {
+            escaped = true;
+            break;
+        }
+
+        // dz_(n+1)/dz_1 = 2 * z_n * dz_n/dz_1, z_1 = c starts it at 1
+        if (Policy::INTERIOR) {
+            D zr_d = Number::derivative(zr);
+            D zi_d = Number::derivative(zi);
+            D next_der_r = zr_d * der_r - zi_d * der_i;
+            der_i = zr_d * der_i + zi_d * der_r;
+            der_i = der_i + der_i;
+            der_r = next_der_r + next_der_r;
+            if (der_r * der_r + der_i * der_i < interior_threshold) {
+                interior = true;
+                break;
+            }
+        }
+
+        // Periodicity checking (Brent): compare against the point saved at the last power of two,
+        // so a cycle of any length is found once the window has grown past it
+        if (Policy::PERIODICITY) {
+            T dr = zr - old_zr;
+            T di = zi - old_zi;
+            if (dr <= epsilon && -epsilon <= dr && di <= epsilon && -epsilon <= di) {
+                interior = true;
                 break;
             }
 
-            period++;
-            if (period > 20) {
-                period = 0;
-                z_old = z;
+            if (iteration == next_save) {
+                next_save <<= 1;
+                old_zr = zr;
+                old_zi = zi;
             }
         }
     }
 
-    // Smooth coloring
-    if (iteration < iter_limit) {
-        double log_zn = std::log(std::abs(z)) / 2;
-        double nu = std::log(log_zn / std::log(2)) / std::log(2);
-        state->pixelState[y][x].setSmoothIterationFloat(iteration + 1 - nu);
+    stats::count(stats::ITERATIONS, iteration - first_iteration);
+    if (interior) {
+        complete_interior(pixel);
+        stats::count(stats::PERIODICITY_EXITS);
+        return;
+    }
+    double norm = 0;
+    if (escaped) {
+        stats::count(stats::ESCAPED);
+        double zr_double = Number::to_double(zr);
+        double zi_double = Number::to_double(zi);
+        norm = zr_double * zr_double + zi_double * zi_double;
     } else {
-        state->pixelState[y][x].setSmoothIterationFloat(1.0f);
+        // Only orbits that are still bounded can be continued at a higher limit
+        stats::count(stats::MAX_ITERATION);
+        if (x >= 0) {
+            orbit_pool.save(slot, x, y, iteration, zr, zi, der_r, der_i);
+        }
+    }
+    complete_pixel<Policy::SMOOTHING>(pixel, iteration, iter_limit, norm);
+}
+
+// The imaginary part is shared by a row, it is only computed when the source moves to another one
+template <typename T, typename Policy, typename Source>
+void Fractalis::iterate_source(Source& source, int iter_limit) {
+    using Number = KernelNumber<T>;
+
+    if constexpr (!LaneVector<T>::BATCHED) {
+        int x, y;
+        int row = -1;
+        T ci{};
+        while (source.next(x, y)) {
+            if (state->isPixelComplete(x, y)) {
+                continue;
+            }
+            if (y != row) {
+                row = y;
+                ci = Number::imag(geometry, y - geometry.center_y);
+            }
+            iterate_point<T, Policy>(state->at(x, y), Number::real(geometry, x - geometry.center_x), ci, iter_limit, x, y);
+            state->setPixelComplete(x, y);
+        }
+        return;
+    }
+
+    // The same steps as iterate_point() in the same order, on all lanes at once. A lane is refilled
+    // with the next pixel as soon as its orbit is done
+    using Lanes = typename LaneVector<T>::type;
+    using D = typename Number::Derivative;
+    using DerivativeLanes = std::decay_t<decltype(derivative_lanes(std::declval<Lanes>()))>;
+    constexpr int LANES = Lanes::SIZE;
+
+    const T zero{};
+    const T epsilon = Number::from_double(geometry.periodicity_epsilon);
+    const D interior_threshold = static_cast<D>(Policy::INTERIOR_THRESHOLD);
+    Lanes cr = Lanes::broadcast(zero), ci = Lanes::broadcast(zero);
+    Lanes zr = cr, zi = cr;
+    Lanes zr2 = cr, zi2 = cr;
+    Lanes old_zr = cr, old_zi = cr;
+    DerivativeLanes der_r = DerivativeLanes::broadcast(1), der_i = DerivativeLanes::broadcast(0);
+    PixelState* lane_pixel[LANES];
+    PixelCoord lane_coord[LANES];
+    int lane_slot[LANES];
+    int iteration[LANES];
+    int next_save[LANES];
+    int active = 0;
+    int row = -1;
+    T row_ci{};
+
+    // Continue the orbit of a lane from its snapshot in the orbit pool
+    auto resume = [&](int lane) {
+        T saved_zr, saved_zi;
+        double saved_der_r, saved_der_i;
+        orbit_pool.load(lane_slot[lane], iteration[lane], saved_zr, saved_zi, saved_der_r, saved_der_i);
+        zr.set(lane, saved_zr);
+        zi.set(lane, saved_zi);
+        zr2.set(lane, saved_zr * saved_zr);
+        zi2.set(lane, saved_zi * saved_zi);
+        old_zr.set(lane, saved_zr);
+        old_zi.set(lane, saved_zi);
+        der_r.set(lane, static_cast<D>(saved_der_r));
+        der_i.set(lane, static_cast<D>(saved_der_i));
+        while (next_save[lane] <= iteration[lane]) {
+            next_save[lane] <<= 1;
+        }
+    };
+
+    // Start the next pixel that needs iterating in a lane. An idle lane iterates c = 0, which stays at 0
+    auto refill = [&](int lane) {
+        zr.set(lane, zero);
+        zi.set(lane, zero);
+        zr2.set(lane, zero);
+        zi2.set(lane, zero);
+        old_zr.set(lane, zero);
+        old_zi.set(lane, zero);
+        der_r.set(lane, 1);
+        der_i.set(lane, 0);
+        iteration[lane] = 0;
+        next_save[lane] = 1;
+        int x, y;
+        while (source.next(x, y)) {
+            if (state->isPixelComplete(x, y)) {
+                continue;
+            }
+            PixelState& pixel = state->at(x, y);
+            if (y != row) {
+                row = y;
+                row_ci = Number::imag(geometry, y - geometry.center_y);
+            }
+            T re = Number::real(geometry, x - geometry.center_x);
+            if (Policy::BULB_CHECK && is_in_main_bulb(re, row_ci)) {
+                complete_interior(pixel);
+                state->setPixelComplete(x, y);
+                stats::count(stats::BULB_SKIPS);
+                continue;
+            }
+            cr.set(lane, re);
+            ci.set(lane, row_ci);
+            lane_pixel[lane] = &pixel;
+            lane_coord[lane] = {static_cast<int16_t>(x), static_cast<int16_t>(y)};
+            lane_slot[lane] = orbit_pool.find<T>(x, y);
+            if (lane_slot[lane] >= 0) {
+                resume(lane);
+            }
+            active |= 1 << lane;
+            return;
+        }
+        cr.set(lane, zero);
+        ci.set(lane, zero);
+        active &= ~(1 << lane);
+    };
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        refill(lane);
     }
 
-    state->pixelState[y][x].iteration = iteration;
-    state->pixelState[y][x].setIsComplete(true);
+    while (active) {
+        // Iterate until a lane escapes, or has to save its periodicity point or stop at the limit
+        int run = iter_limit;
+        for (int lane = 0; lane < LANES; ++lane) {
+            if (active & (1 << lane)) {
+                int event = Policy::PERIODICITY ? std::min(next_save[lane], iter_limit) : iter_limit;
+                run = std::min(run, event - iteration[lane]);
+            }
+        }
+
+        int steps = 0;
+        int escaped = 0;
+        int periodic = 0;
+        while (steps < run) {
+            zi = (zr + zr) * zi + ci;
+            zr = zr2 - zi2 + cr;
+            steps++;
+            zr2 = zr * zr;
+            zi2 = zi * zi;
+            escaped = Lanes::escaped_mask(zr, zi, zr2, zi2) & active;
+            // Escaped lanes take precedence below, an interior bit of theirs doesn't matter
+            if (Policy::INTERIOR) {
+                const DerivativeLanes& zr_d = derivative_lanes(zr);
+                const DerivativeLanes& zi_d = derivative_lanes(zi);
+                DerivativeLanes next_der_r = zr_d * der_r - zi_d * der_i;
+                der_i = zr_d * der_i + zi_d * der_r;
+                der_i = der_i + der_i;
+                der_r = next_der_r + next_der_r;
+                periodic = DerivativeLanes::norm_below_mask(der_r, der_i, interior_threshold) & active;
+            }
+            if (Policy::PERIODICITY) {
+                periodic |= Lanes::within_mask(zr - old_zr, zi - old_zi, epsilon) & active;
+            }
+            if (escaped | periodic) {
+                break;
+            }
+        }
+        stats::count(stats::ITERATIONS, steps * __builtin_popcount(active));
+
+        for (int lane = 0; lane < LANES; ++lane) {
+            const int bit = 1 << lane;
+            if (!(active & bit)) {
+                continue;
+            }
+            iteration[lane] += steps;
+            if (escaped & bit) {
+                double zr_double = Number::to_double(zr.get(lane));
+                double zi_double = Number::to_double(zi.get(lane));
+                complete_pixel<Policy::SMOOTHING>(*lane_pixel[lane], iteration[lane], iter_limit,
+                                                  zr_double * zr_double + zi_double * zi_double);
+                stats::count(stats::ESCAPED);
+            } else if (periodic & bit) {
+                complete_interior(*lane_pixel[lane]);
+                stats::count(stats::PERIODICITY_EXITS);
+            } else if (iteration[lane] >= iter_limit) {
+                orbit_pool.save(lane_slot[lane], lane_coord[lane].x, lane_coord[lane].y, iteration[lane], zr.get(lane),
+                                zi.get(lane), der_r.get(lane), der_i.get(lane));
+                complete_pixel<Policy::SMOOTHING>(*lane_pixel[lane], iter_limit, iter_limit, 0);
+                stats::count(stats::MAX_ITERATION);
+            } else {
+                if (Policy::PERIODICITY && iteration[lane] == next_save[lane]) {
+                    next_save[lane] <<= 1;
+                    old_zr.set(lane, zr.get(lane));
+                    old_zi.set(lane, zi.get(lane));
+                }
+                continue;
+            }
+            state->setPixelComplete(lane_coord[lane].x, lane_coord[lane].y);
+            refill(lane);
+        }
+    }
 }
 
+void Fractalis::calculate_pixel_perturbation(int x, int y, int iter_limit) {
+    perturbation.calculate_pixel(x, y, iter_limit);
+}
 
-void Fractalis::calculate_pixel_dd(int x, int y, int iter_limit) {
-    if (x < 0 || x >= state->screen_w || y < 0 || y >= state->screen_h) {
-        return;
+void Fractalis::calculate_pixels_perturbation(const PixelCoord* pixels, int count, int iter_limit) {
+    PixelList source(pixels, count, *state, frame_calculation_id);
+    int x, y;
+    while (source.next(x, y)) {
+        perturbation.calculate_pixel(x, y, iter_limit);
     }
-    if (state->pixelState[y][x].isComplete()) {
-        return;
+}
+
+void Fractalis::calculate_tile_perturbation(int x1, int y1, int x2, int y2, int x_step, int iter_limit) {
+    PixelRect source(x1, y1, x2, y2, x_step, *state, frame_calculation_id);
+    int x, y;
+    while (source.next(x, y)) {
+        perturbation.calculate_pixel(x, y, iter_limit);
     }
+}
 
-    std::complex<DoubleDouble> c = pixel_to_point_dd(x, y);
+void Fractalis::force_tier(PrecisionTier forced) {
+    tier_forced = true;
+    forced_tier = forced;
+}
 
-    int iteration = 0;
-    std::complex<DoubleDouble> z(0, 0);
+void Fractalis::unforce_tier() {
+    tier_forced = false;
+}
 
-    while ((z.real() * z.real() + z.imag() * z.imag()).sqrt() <= 2 && iteration < iter_limit) {
-        z = f_c(c, z);
-        iteration++;
+void Fractalis::begin_frame(int iter_limit) {
+    frame_calculation_id = state->calculation_id;
+    tier = select_tier();
+    geometry.update(*state);
+    // And the orbit pool in the number format of the kernels
+    select_kernels();
+    if (tier == PrecisionTier::PERTURBATION) {
+        perturbation.begin_frame(iter_limit);
     }
+}
 
-    // Smooth coloring
-    if (iteration < iter_limit) {
-        DoubleDouble log_zn = (z.real() * z.real() + z.imag() * z.imag()).log() / DoubleDouble(2);
-        DoubleDouble log_N = DoubleDouble(16) * dd_ln2;
-        DoubleDouble nu = (log_zn / log_N).log() / dd_ln2;
-        state->pixelState[y][x].setSmoothIterationFloat((iteration + DoubleDouble(1) - nu).upper);
-    } else {
-        state->pixelState[y][x].setSmoothIterationFloat(1.0f);
+bool Fractalis::finish_frame(int iter_limit) {
+    if (tier != PrecisionTier::PERTURBATION) {
+        return true;
+    }
+
+    // Glitched pixels are the only incomplete ones left after a full pass
+    int references = 1;
+    while (references < Perturbation::MAX_REFERENCES && perturbation.rebase(iter_limit)) {
+        references++;
+        for (int y = 0; y < state->screen_h; ++y) {
+            if (state->calculation_id != frame_calculation_id) {
+                return false;
+            }
+            calculate_tile_perturbation(0, y, state->screen_w - 1, y, 1, iter_limit);
+        }
     }
 
-    state->pixelState[y][x].iteration = iteration;
-    state->pixelState[y][x].setIsComplete(true);
+    // Whatever is still glitched gets the slow, but exact, DoubleDouble treatment
+    for (int y = 0; y < state->screen_h; ++y) {
+        if (state->calculation_id != frame_calculation_id) {
+            return false;
+        }
+        calculate_tile_kernel<DoubleDouble, DeepPolicy>(0, y, state->screen_w - 1, y, 1, iter_limit);
+    }
+    printf("Perturbation: frame finished with %d references\n", references);
+    return true;
 }
 
 void Fractalis::calculate_pixel(int x, int y, int iter_limit) {
-    if (needsHighPrecision()) {
-        calculate_pixel_dd(x, y, iter_limit);
-    } else {
-        calculate_pixel_double(x, y, iter_limit);
+    (this->*pixel_kernel)(x, y, iter_limit);
+}
+
+void Fractalis::calculate_pixels(const PixelCoord* pixels, int count, int iter_limit) {
+    (this->*batch_kernel)(pixels, count, iter_limit);
+}
+
+void Fractalis::calculate_row(int y, int x1, int x2, int iter_limit, int x_step) {
+    (this->*tile_kernel)(x1, y, x2, y, x_step, iter_limit);
+}
+
+void Fractalis::calculate_tile(int x1, int y1, int x2, int y2, int iter_limit) {
+    (this->*tile_kernel)(x1, y1, x2, y2, 1, iter_limit);
+}
+
+bool Fractalis::calculate_sample(int x, int y, double dx, double dy, int iter_limit, PixelState& sample) {
+    if (tier == PrecisionTier::PERTURBATION) {
+        return perturbation.calculate_sample(x + dx, y + dy, iter_limit, sample);
     }
+    FrameGeometry frame = geometry;
+    frame.offset(dx, dy);
+    (this->*sample_kernel)(frame, x, y, iter_limit, sample);
+    return true;
 }
 
 void Fractalis::zoom(double factor) {
-    state->zoom_factor *= 1.L + factor;
+    if (factor > 0 && state->zoom_factor >= MAX_ZOOM) {
+        return;
+    }
+    // The calculation in progress stops first, it would write pixels of the old view over moved ones
+    state->beginViewChange();
+    double old_zoom_factor = state->zoom_factor;
+    state->zoom_factor = std::min<double>(state->zoom_factor * (1.L + factor), MAX_ZOOM);
+    // Only at power of two ratios and in the same tier c of a kept pixel is bit exact, see reprojectPixelState()
+    // for what that guarantees. After a switch to a more precise tier, pixels near its precision limit would stay off
+    double ratio = state->zoom_factor / old_zoom_factor;
+    int exponent;
+    if (std::frexp(ratio, &exponent) == 0.5 && select_tier() == tier) {
+        state->reprojectPixelState(ratio, state->iteration_limit);
+    } else {
+        state->resetPixelComplete();
+    }
     state->calculating = 2;
-    state->calculation_id++;
-    state->last_updated_radius = 0;
     state->rendering = 3;
+    state->endViewChange();
     printf("Zooming. New Zoom Factor: %f\n", state->zoom_factor);
 }
 
@@ -161,6 +652,9 @@ void Fractalis::pan(double dx, double dy) {
     int pixel_shift_x = (std::abs(dx) * state->screen_w);
     int pixel_shift_y = (std::abs(dy) * state->screen_h * state->ASPECT_RATIO);
 
+    // The calculation in progress stops first, it would write pixels of the old view over shifted ones
+    state->beginViewChange();
+
     // Shift pixel state
     if (dx > 0) {
         state->last_pan_direction = PAN_RIGHT;
@@ -179,29 +673,37 @@ void Fractalis::pan(double dx, double dy) {
 
     state->calculating = 1;
     state->rendering = 3;
-    state->calculation_id++;
-    state->last_updated_radius = 0;
 
     constexpr double INITIAL_VIEW_WIDTH = 4.0;
     DoubleDouble range = DoubleDouble(INITIAL_VIEW_WIDTH) / DoubleDouble(state->zoom_factor);
     state->pan_real += DoubleDouble(dx * range);
     state->pan_imag += DoubleDouble(dy * range);
+    state->endViewChange();
 }
 
-bool Fractalis::is_in_main_bulb(const std::complex<double>& c) {
-    double x = c.real();
-    double y = c.imag();
+// Only evaluated inside boxes around cardioid and bulb, outside of them the terms could overflow a fixed point format
+template <typename T>
+bool Fractalis::is_in_main_bulb(const T& x, const T& y) {
+    using Number = KernelNumber<T>;
+    const T one = Number::dyadic(1, 0);
+    const T half = Number::dyadic(1, 1);
+    const T quarter = Number::dyadic(1, 2);
+    const T sixteenth = Number::dyadic(1, 4);
 
     // Check for main cardioid
-    double q = (x - 0.25) * (x - 0.25) + y * y;
-    if (q * (q + (x - 0.25)) <= 0.25 * y * y) {
-        return true;
+    if (x > -one && x < half && y > -(half + quarter) && y < half + quarter) {
+        T xq = x - quarter;
+        T q = xq * xq + y * y;
+        if (q * (q + xq) <= quarter * y * y) {
+            return true;
+        }
     }
 
     // Check for period-2 bulb
-    if ((x + 1) * (x + 1) + y * y <= 0.0625) {
-        return true;
+    if (x > -(one + half) && x < -half && y > -half && y < half) {
+        T x1 = x + one;
+        return x1 * x1 + y * y <= sixteenth;
     }
 
     return false;
-}
\ No newline at end of file
+}
@@ -3,14 +3,90 @@
 
 #include "FractalisState.h"
 #include "doubledouble.h"
+#include "floatfloat.h"
+#include "fixedpoint.h"
+#include "perturbation.h"
+#include "kernel.h"
+#include "lanes.h"
+#include "orbitpool.h"
 #include <complex>
 
 using namespace doubledouble;
+using floatfloat::FloatFloat;
+using fixedpoint::Fixed32;
+using fixedpoint::Fixed64;
+
+// Number formats a frame can be calculated in
+enum class PrecisionTier {
+    FLOAT,
+    FLOAT_FLOAT,
+    FIXED32,
+    FIXED64,
+    DOUBLE,
+    DOUBLE_DOUBLE,
+    PERTURBATION
+};
+
+// Screen position of a pixel, for batches of pixels
+struct PixelCoord {
+    int16_t x;
+    int16_t y;
+};
 
 class Fractalis {
 public:
     Fractalis(FractalisState* state);
+    /**
+     * @brief Prepare everything that is shared by all pixels of a calculation pass,
+     * e.g. the perturbation reference orbit. Call before calculating the first pixel.
+     */
+    void begin_frame(int iter_limit);
+    /**
+     * @brief Finish a calculation pass by re-rendering the pixels that glitched in the perturbation renderer.
+     * @return false if the calculation was interrupted.
+     */
+    bool finish_frame(int iter_limit);
     void calculate_pixel(int x, int y, int iter_limit);
+    /**
+     * @brief Calculate a batch of pixels. Iterates several of them at once, results are identical
+     * to calculate_pixel() on each.
+     */
+    void calculate_pixels(const PixelCoord* pixels, int count, int iter_limit);
+    /**
+     * @brief Calculate the pixels x1, x1 + x_step, ... up to x2 of row y. Bounds are clipped once for the whole span.
+     */
+    void calculate_row(int y, int x1, int x2, int iter_limit, int x_step = 1);
+    /**
+     * @brief Calculate the rectangle from (x1, y1) to (x2, y2), corners included, row by row.
+     */
+    void calculate_tile(int x1, int y1, int x2, int y2, int iter_limit);
+    /**
+     * @brief Calculate the point at (x + dx, y + dy) of the current frame into sample, e.g. for supersampling.
+     * The pixels of the state are left untouched.
+     * @return false if the point could not be calculated precisely enough (a perturbation glitch).
+     */
+    bool calculate_sample(int x, int y, double dx, double dy, int iter_limit, PixelState& sample);
+    PrecisionTier get_tier() const { return tier; }
+    /**
+     * @brief Calculate the following frames in the given tier regardless of the zoom, e.g. to benchmark tiers against each other.
+     */
+    void force_tier(PrecisionTier forced);
+    void unforce_tier();
+    /**
+     * @brief Pixel spacing of the current view in units of epsilon of the largest coordinate on screen, e.g.
+     * DBL_EPSILON. Neighbouring pixels are that many ulps apart in a format with this epsilon.
+     */
+    double spacing_in_ulps(double epsilon);
+
+    // A tier is used while the pixel spacing is at least this many of its ulps of the view coordinates
+    static constexpr double ULP_MARGIN = 512.0;
+    // FloatFloat has 2x24 bits of mantissa
+    static constexpr double FLOAT_FLOAT_EPSILON = static_cast<double>(FLT_EPSILON) * FLT_EPSILON;
+
+    /**
+     * @brief Multiply the zoom factor by 1 + factor around the screen center. Pixels of the last frame that
+     * lie exactly on the new one are kept, see FractalisState::reprojectPixelState().
+     */
     void zoom(double factor);
     /**
      * @brief Pan the fractal view by the given amount.
@@ -21,14 +97,56 @@ public:
 
 private:
     FractalisState* state;
-    std::complex<DoubleDouble> f_c(const std::complex<DoubleDouble>& c, const std::complex<DoubleDouble>& z = std::complex<DoubleDouble>(0, 0));
-    std::complex<double> pixel_to_point_double(int x, int y);
-    std::complex<DoubleDouble> pixel_to_point_dd(int x, int y);
-    bool needsHighPrecision();
-    void calculate_pixel_double(int x, int y, int iter_limit);
-    void calculate_pixel_dd(int x, int y, int iter_limit);
-    bool is_in_main_bulb(const std::complex<double>& c);
-    bool approximately_equal(const std::complex<double>& a, const std::complex<double>& b, double epsilon = 1e-12);
+    // Orbits that reached the limit of the last frame, continued by the kernels once the limit was raised
+    OrbitPool orbit_pool;
+    Perturbation perturbation;
+    PrecisionTier tier;
+    bool tier_forced;
+    PrecisionTier forced_tier;
+    FrameGeometry geometry;
+    // Kernel of the current frame, picked once in begin_frame()
+    using PixelKernel = void (Fractalis::*)(int x, int y, int iter_limit);
+    PixelKernel pixel_kernel;
+    using BatchKernel = void (Fractalis::*)(const PixelCoord* pixels, int count, int iter_limit);
+    BatchKernel batch_kernel;
+    using TileKernel = void (Fractalis::*)(int x1, int y1, int x2, int y2, int x_step, int iter_limit);
+    TileKernel tile_kernel;
+    using SampleKernel = void (Fractalis::*)(const FrameGeometry& frame, int x, int y, int iter_limit, PixelState& sample);
+    SampleKernel sample_kernel;
+    uint8_t frame_calculation_id;
+    double pixel_spacing();
+    double view_magnitude();
+    bool precisionSufficient(double epsilon);
+    PrecisionTier select_tier();
+    void select_kernels();
+    template <typename T>
+    void select_kernels_for();
+    /**
+     * @brief The escape time kernel of every tier but perturbation.
+     * @tparam T Number format, see KernelNumber.
+     * @tparam Policy Optional optimizations, see KernelPolicy.
+     */
+    template <typename T, typename Policy>
+    void calculate_pixel_kernel(int x, int y, int iter_limit);
+    template <typename T, typename Policy>
+    void calculate_pixels_kernel(const PixelCoord* pixels, int count, int iter_limit);
+    template <typename T, typename Policy>
+    void calculate_tile_kernel(int x1, int y1, int x2, int y2, int x_step, int iter_limit);
+    template <typename T, typename Policy>
+    void calculate_sample_kernel(const FrameGeometry& frame, int x, int y, int iter_limit, PixelState& sample);
+    template <typename T, typename Policy>
+    void iterate_point(PixelState& pixel, const T& cr, const T& ci, int iter_limit, int x, int y);
+    /**
+     * @brief Calculate the incomplete pixels handed out by source. Formats with LaneVector<T>::BATCHED
+     * iterate one pixel per lane and refill a lane as soon as its pixel is done.
+     */
+    template <typename T, typename Policy, typename Source>
+    void iterate_source(Source& source, int iter_limit);
+    void calculate_pixel_perturbation(int x, int y, int iter_limit);
+    void calculate_pixels_perturbation(const PixelCoord* pixels, int count, int iter_limit);
+    void calculate_tile_perturbation(int x1, int y1, int x2, int y2, int x_step, int iter_limit);
+    template <typename T>
+    bool is_in_main_bulb(const T& x, const T& y);
 };
 
 #endif // FRACTALIS_H
\ No newline at end of file
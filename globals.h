@@ -2,11 +2,57 @@
 #define GLOBALS_H
 
 #define DEBUG true
+// Count iterations, interior exits and escaped pixels in the kernels and time the frame stages, printed as one
+// line per calculation pass, see stats.h. Off it costs nothing. Host builds can set it, see host/CMakeLists.txt
+#ifndef COLLECT_STATS
+#define COLLECT_STATS false
+#endif
 #define UPDATE_SLEEP 16
 #define LONG_PRESS_DURATION 150/UPDATE_SLEEP
 #define PAN_CONSTANT 0.1L
-#define ZOOM_CONSTANT 0.1L
-#define UPDATE_INTERVAL 10  // Update display every n pixels calculated
+// Zoom steps of 10% by default. With ZOOM_POWER_OF_TWO they double the zoom factor instead, and zooming out
+// halves it. Every other pixel of every other row of the new frame then is a pixel of the frame before, zooming
+// out keeps the frame before as the central quarter. These pixels are reused instead of calculated again
+#define ZOOM_POWER_OF_TWO false
+#define ZOOM_CONSTANT (ZOOM_POWER_OF_TWO ? 1.0L : 0.1L)
+// Deepest zoom. The view center is kept in DoubleDouble, there neighbouring pixels at the largest coordinates of
+// the set are still Fractalis::ULP_MARGIN ulps apart in it. It also bounds the iteration limit, and with it the
+// reference orbit of perturbation, to 3224 iterations
+#define MAX_ZOOM 1e26
+#define DEFAULT_RENDER_MODE RENDER_PROGRESSIVE
+
+// Antialiasing of finished frames: pixels on a color edge get AA_SAMPLES extra samples within their area,
+// at most AA_SAMPLE_BUDGET samples per frame (6144 is 8% of a 320x240 frame). AA_SAMPLES 0 disables it
+#define AA_SAMPLES 4
+#define AA_SAMPLE_BUDGET 6144
+// A pixel is an edge if a color channel differs by at least this much from one of its neighbors
+#define AA_EDGE_THRESHOLD 32
+
+// The RP2040's Cortex-M0+ and the RP2350's RISC-V cores have no FPU, every float and double operation is a library call there
+#if (defined(__arm__) && !defined(__ARM_FP)) || (defined(__riscv) && !defined(__riscv_flen))
+#define HAS_FPU false
+#else
+#define HAS_FPU true
+#endif
+// The RP2350's Cortex-M33 has a single precision FPU only, double is emulated there
+#if (defined(__arm__) && !(defined(__ARM_FP) && (__ARM_FP & 8))) || (defined(__riscv) && !(defined(__riscv_flen) && __riscv_flen >= 64))
+#define HAS_DOUBLE_FPU false
+#else
+#define HAS_DOUBLE_FPU true
+#endif
+
+// Calculate in fixed point integers wherever the zoom allows it
+#define USE_FIXED_POINT !HAS_FPU
+
+// Calculate mid zooms in FloatFloat instead of double. Faster where float is native and double emulated (pico 2).
+// Host builds can set it, see host/CMakeLists.txt
+#ifndef USE_FLOAT_FLOAT
+#define USE_FLOAT_FLOAT (HAS_FPU && !HAS_DOUBLE_FPU)
+#endif
+
+// Orbits that reached the iteration limit are kept in a pool of this many, 56 bytes each, and continued
+// when the limit is raised after the pre-render. Pixels that don't fit are iterated from zero again
+#define RESUME_POOL_SIZE 256
 
 #define LOWEST_ITER 25
 #define MAX_ITER 10000
@@ -14,5 +60,11 @@
 #define START_HUE 0.6222
 #define SATURATION_THRESHOLD 0.08f
 #define VALUE_THRESHOLD 0.06f
+// Colors are a fixed function of the smooth iteration count by default. With EQUALIZE_COLORS they follow the
+// distribution of the iteration counts on screen instead (histogram equalization), so each part of the hue wheel
+// covers about as many pixels as any other. Colors then change as the frame fills in
+#define EQUALIZE_COLORS false
+// Turns of the hue wheel from the lowest to the highest iteration count on screen, if equalized
+#define EQUALIZED_HUE_CYCLES 1.0f
 
 #endif // GLOBALS_H
\ No newline at end of file
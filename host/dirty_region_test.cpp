@@ -0,0 +1,109 @@
+//
+// DirtyRegion against MockDisplayOutput: the windows a flush sends and the bytes they cost on the wire.
+// Exits with 1 if a case differs.
+//
+
+#include "DirtyRegion.hpp"
+#include "MockDisplayOutput.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <vector>
+
+namespace {
+
+constexpr int WIDTH = 320;
+constexpr int HEIGHT = 240;
+
+uint64_t window_bytes(const ScreenRect& rect) {
+    return DisplayOutput::WINDOW_BYTES +
+           static_cast<uint64_t>(rect.x2 - rect.x1 + 1) * (rect.y2 - rect.y1 + 1) * DisplayOutput::BYTES_PER_PIXEL;
+}
+
+// Flush the rectangles added to a new region, the windows sent must be expected, in this order
+int check(const char* name, std::initializer_list<ScreenRect> added, bool all,
+          std::initializer_list<ScreenRect> expected) {
+    DirtyRegion region(WIDTH, HEIGHT);
+    MockDisplayOutput output(WIDTH, HEIGHT);
+    for (const ScreenRect& rect : added) {
+        region.add(rect);
+    }
+    if (all) {
+        region.add_all();
+    }
+    region.flush(output);
+
+    uint64_t expected_bytes = 0;
+    for (const ScreenRect& rect : expected) {
+        expected_bytes += window_bytes(rect);
+    }
+    const std::vector<ScreenRect>& sent = output.transfers();
+    bool same = sent.size() == expected.size() && output.bytes() == expected_bytes && output.frames() == 1 &&
+                region.empty();
+    const ScreenRect* want = expected.begin();
+    for (size_t i = 0; same && i < sent.size(); ++i) {
+        same = sent[i].x1 == want[i].x1 && sent[i].y1 == want[i].y1 && sent[i].x2 == want[i].x2 &&
+               sent[i].y2 == want[i].y2;
+    }
+    printf("dirty_region,%s,%zu,%llu,%s\n", name, sent.size(), static_cast<unsigned long long>(output.bytes()),
+           same ? "ok" : "FAILED");
+    for (const ScreenRect& rect : sent) {
+        printf("  sent %d,%d - %d,%d\n", rect.x1, rect.y1, rect.x2, rect.y2);
+    }
+    return same ? 0 : 1;
+}
+
+} // namespace
+
+int main() {
+    const ScreenRect screen = {0, 0, WIDTH - 1, HEIGHT - 1};
+    int failed = 0;
+
+    printf("dirty_region,case,windows,bytes,result\n");
+    failed += check("empty", {}, false, {});
+    failed += check("clipped", {{-5, -5, 4, 4}, {WIDTH, 0, WIDTH + 9, 9}}, false, {{0, 0, 4, 4}});
+    // The union of neighbours is no larger than both, of distant ones it is far larger than a window command
+    failed += check("adjacent", {{0, 0, 9, 9}, {10, 0, 19, 9}}, false, {{0, 0, 19, 9}});
+    failed += check("distant", {{0, 0, 9, 9}, {100, 100, 109, 109}}, false, {{0, 0, 9, 9}, {100, 100, 109, 109}});
+    // The gap between the first two is closed by the third, the grown rectangle then takes in the other one
+    failed += check("bridged", {{0, 0, 9, 9}, {20, 0, 29, 9}, {10, 0, 19, 9}}, false, {{0, 0, 29, 9}});
+    // Above the full share of the screen one window for all of it beats the rectangles
+    failed += check("full_share", {{0, 0, WIDTH - 1, 149}}, false, {screen});
+    failed += check("below_full_share", {{0, 0, WIDTH - 1, 119}}, false, {{0, 0, WIDTH - 1, 119}});
+    failed += check("add_all", {{0, 0, 9, 9}, {100, 100, 109, 109}}, true, {screen});
+
+    // Rectangles of more than MAX_RECTS distant places still go out, grown into each other
+    std::vector<ScreenRect> scattered;
+    for (int i = 0; i <= DirtyRegion::MAX_RECTS; ++i) {
+        const int16_t x = static_cast<int16_t>(i * 30);
+        scattered.push_back({x, 0, x, 0});
+    }
+    DirtyRegion region(WIDTH, HEIGHT);
+    MockDisplayOutput output(WIDTH, HEIGHT);
+    for (const ScreenRect& rect : scattered) {
+        region.add(rect);
+    }
+    region.flush(output);
+    region.add_all();
+    region.flush(output);
+    bool covered = output.transfers().size() <= DirtyRegion::MAX_RECTS + 1u;
+    for (const ScreenRect& rect : scattered) {
+        bool in = false;
+        for (size_t i = 0; i + 1 < output.transfers().size(); ++i) {
+            const ScreenRect& sent = output.transfers()[i];
+            in |= sent.x1 <= rect.x1 && rect.x2 <= sent.x2 && sent.y1 <= rect.y1 && rect.y2 <= sent.y2;
+        }
+        covered &= in;
+    }
+    // The second frame is a full update, it costs what full_update_bytes() has for one frame
+    uint64_t first_frame_bytes = 0;
+    for (size_t i = 0; i + 1 < output.transfers().size(); ++i) {
+        first_frame_bytes += window_bytes(output.transfers()[i]);
+    }
+    covered &= output.frames() == 2 && output.bytes() == first_frame_bytes + output.full_update_bytes() / 2;
+    printf("dirty_region,overflow,%zu,%llu,%s\n", output.transfers().size(),
+           static_cast<unsigned long long>(output.bytes()), covered ? "ok" : "FAILED");
+    failed += !covered;
+
+    return failed ? 1 : 0;
+}
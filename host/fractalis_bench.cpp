@@ -0,0 +1,269 @@
+//
+// Kernel benchmark: calculates a fixed catalogue of views in every precision tier that can resolve them and
+// times the DoubleDouble primitives one by one. Prints CSV, one table per kind of measurement with the kind in
+// the first column, so runs before and after a change can be diffed or joined.
+//
+//   fractalis_bench > before.csv
+//
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include "doubledouble.h"
+#include "globals.h"
+#include "host_util.h"
+#include "views.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int width = 160;
+    int height = 120;
+    // Every measurement is repeated until it took at least this long
+    double min_seconds = 0.5;
+    const char* view = nullptr;
+    bool all_tiers = false;
+    bool primitives = true;
+};
+
+struct Result {
+    long long pixels = 0;
+    long long iterations = 0;
+    double seconds = 0;
+};
+
+// One frame through calculate_pixel() pixel by pixel, or through calculate_row(), which batches pixels in lanes.
+// Iterations are the work of a plain escape time loop: escaped pixels count their iteration, all others the
+// limit. Skipping interior pixels early shows as more iterations per second
+Result calculate_frame(FractalisState& state, Fractalis& fractalis, int iter_limit, bool rows) {
+    // A new id starts the orbit pool over, nothing is resumed from the frame before
+    state.calculation_id++;
+    state.resetPixelComplete();
+    const Clock::time_point start = Clock::now();
+    fractalis.begin_frame(iter_limit);
+    for (int y = 0; y < state.screen_h; ++y) {
+        if (rows) {
+            fractalis.calculate_row(y, 0, state.screen_w - 1, iter_limit);
+            continue;
+        }
+        for (int x = 0; x < state.screen_w; ++x) {
+            fractalis.calculate_pixel(x, y, iter_limit);
+        }
+    }
+    fractalis.finish_frame(iter_limit);
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (int y = 0; y < state.screen_h; ++y) {
+        for (int x = 0; x < state.screen_w; ++x) {
+            const int iteration = state.at(x, y).iteration;
+            result.iterations += iteration < iter_limit ? iteration : iter_limit;
+        }
+    }
+    result.pixels = static_cast<long long>(state.screen_w) * state.screen_h;
+    return result;
+}
+
+void benchmark_view(const host::View& view, const Options& options) {
+    FractalisState state(options.width, options.height);
+    Fractalis fractalis(&state);
+    state.center = {host::parse_decimal(view.real), host::parse_decimal(view.imag)};
+    state.zoom_factor = view.zoom;
+
+    fractalis.begin_frame(view.iter_limit);
+    const PrecisionTier selected = fractalis.get_tier();
+
+    for (PrecisionTier tier : host::available_tiers()) {
+        // Less precise tiers than the selected one calculate a different picture
+        if (!options.all_tiers && tier != selected && host::tier_rank(tier) < host::tier_rank(selected)) {
+            continue;
+        }
+        fractalis.force_tier(tier);
+        for (bool rows : {false, true}) {
+            Result total;
+            int frames = 0;
+            while (frames == 0 || total.seconds < options.min_seconds) {
+                Result frame = calculate_frame(state, fractalis, view.iter_limit, rows);
+                total.pixels += frame.pixels;
+                total.iterations += frame.iterations;
+                total.seconds += frame.seconds;
+                frames++;
+            }
+            printf("kernel,%s,%s,%s,%d,%d,%d,%lld,%lld,%.6f,%.4f,%.4f,%.3f\n", view.name, host::tier_name(tier),
+                   rows ? "row" : "pixel", tier == selected, view.iter_limit, frames, total.pixels, total.iterations,
+                   total.seconds, total.pixels / total.seconds / 1e6, total.iterations / total.seconds / 1e6,
+                   total.seconds * 1e9 / total.iterations);
+            fflush(stdout);
+        }
+    }
+    fractalis.unforce_tier();
+}
+
+// Read through a volatile, so the compiler can't fold the loops of the primitive benchmarks
+volatile double seed_one = 1.0;
+volatile double seed_small = 1e-9;
+volatile double sink;
+
+template <typename Operation>
+void benchmark_primitive(const char* name, const Options& options, Operation operation) {
+    const long long operations = 1 << 22;
+    double seconds = 0;
+    long long total = 0;
+    while (total == 0 || seconds < options.min_seconds) {
+        const Clock::time_point start = Clock::now();
+        sink = operation(operations);
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        total += operations;
+    }
+    printf("primitive,%s,%lld,%.6f,%.3f\n", name, total, seconds, seconds * 1e9 / total);
+    fflush(stdout);
+}
+
+// Each operation depends on the result of the one before, the times are latencies
+void benchmark_primitives(const Options& options) {
+    printf("primitive,operation,operations,seconds,ns_per_operation\n");
+    benchmark_primitive("two_sum", options, [](long long n) {
+        double a = seed_one, b = seed_small, low = 0;
+        for (long long i = 0; i < n; ++i) {
+            DoubleDouble r = two_sum(a, b);
+            a = r.upper;
+            low += r.lower;
+        }
+        return a + low;
+    });
+    benchmark_primitive("two_product", options, [](long long n) {
+        double a = seed_one, b = seed_one + seed_small, low = 0;
+        for (long long i = 0; i < n; ++i) {
+            DoubleDouble r = two_product(a, b);
+            a = r.upper;
+            low += r.lower;
+        }
+        return a + low;
+    });
+    benchmark_primitive("add_double", options, [](long long n) {
+        DoubleDouble a(seed_one);
+        const double b = seed_small;
+        for (long long i = 0; i < n; ++i) {
+            a = a + b;
+        }
+        return a.upper + a.lower;
+    });
+    benchmark_primitive("add", options, [](long long n) {
+        DoubleDouble a(seed_one);
+        const DoubleDouble b(seed_small, seed_small * seed_small);
+        for (long long i = 0; i < n; ++i) {
+            a = a + b;
+        }
+        return a.upper + a.lower;
+    });
+    benchmark_primitive("mul_double", options, [](long long n) {
+        DoubleDouble a(seed_one);
+        const double b = seed_one + seed_small;
+        for (long long i = 0; i < n; ++i) {
+            a = a * b;
+        }
+        return a.upper + a.lower;
+    });
+    benchmark_primitive("mul", options, [](long long n) {
+        DoubleDouble a(seed_one);
+        const DoubleDouble b(seed_one + seed_small, seed_small * seed_small);
+        for (long long i = 0; i < n; ++i) {
+            a = a * b;
+        }
+        return a.upper + a.lower;
+    });
+    benchmark_primitive("div", options, [](long long n) {
+        DoubleDouble a(seed_one);
+        const DoubleDouble b(seed_one + seed_small, seed_small * seed_small);
+        for (long long i = 0; i < n; ++i) {
+            a = a / b;
+        }
+        return a.upper + a.lower;
+    });
+    // The inner step of the DoubleDouble kernel: z = z^2 + c
+    benchmark_primitive("mandelbrot_step", options, [](long long n) {
+        DoubleDouble x(seed_small), y(seed_small);
+        const DoubleDouble cr(-0.75 * seed_one), ci(0.1 * seed_one);
+        for (long long i = 0; i < n; ++i) {
+            DoubleDouble xx = x * x;
+            DoubleDouble yy = y * y;
+            y = (x + x) * y + ci;
+            x = xx - yy + cr;
+        }
+        return x.upper + y.upper;
+    });
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --size WxH          screen size of the kernel runs (default 160x120)\n"
+            "  --min-time S        repeat every measurement for at least S seconds (default 0.5)\n"
+            "  --view NAME         only this view of the catalogue\n"
+            "  --all-tiers         also tiers too imprecise for a view\n"
+            "  --no-primitives     skip the DoubleDouble primitives\n"
+            "views:",
+            name);
+    for (const host::View& view : host::VIEWS) {
+        fprintf(stderr, " %s", view.name);
+    }
+    fprintf(stderr, "\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(arg, "--size") && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--min-time") && has_value) {
+            options.min_seconds = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "--view") && has_value) {
+            options.view = argv[++i];
+        } else if (!std::strcmp(arg, "--all-tiers")) {
+            options.all_tiers = true;
+        } else if (!std::strcmp(arg, "--no-primitives")) {
+            options.primitives = false;
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("kernel,view,tier,path,selected,iter_limit,frames,pixels,iterations,seconds,mpixels_per_s,"
+           "miterations_per_s,ns_per_iteration\n");
+    bool found = false;
+    for (const host::View& view : host::VIEWS) {
+        if (options.view && std::strcmp(options.view, view.name)) {
+            continue;
+        }
+        found = true;
+        benchmark_view(view, options);
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (options.primitives) {
+        benchmark_primitives(options);
+    }
+    return 0;
+}
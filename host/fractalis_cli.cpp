@@ -0,0 +1,216 @@
+//
+// Headless renderer: calculates one view like core1 of the pico does, writes it to a PPM file and reports the
+// time it took. A second thread plays core0, it helps with the tiles of progressive passes and sends the
+// published areas to a mock display, so the display traffic is reported as well.
+//
+//   fractalis_cli --center -0.743643887037151 0.131825904205330 --zoom 1e6 --out seahorse.ppm
+//
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include "MarianiSilver.hpp"
+#include "Progressive.hpp"
+#include "TileScheduler.hpp"
+#include "DirtyRegion.hpp"
+#include "MockDisplayOutput.hpp"
+#include "palette.h"
+#include "stats.h"
+#include "globals.h"
+#include "host_util.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    const char* real = "-0.5";
+    const char* imag = "0";
+    double zoom = 1.0;
+    int iterations = 0;  // 0 picks the limit the pico would for the zoom
+    int width = 320;
+    int height = 240;
+    RENDER_MODE mode = DEFAULT_RENDER_MODE;
+    bool pre_render = true;
+    int cores = 2;
+    const char* out = nullptr;
+};
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --center RE IM      view center, decimal, parsed to DoubleDouble (default -0.5 0)\n"
+            "  --zoom Z            zoom factor (default 1)\n"
+            "  --iterations N      iteration limit (default: what the pico picks for the zoom)\n"
+            "  --size WxH          screen size (default 320x240)\n"
+            "  --mode M            progressive or mariani (default progressive)\n"
+            "  --no-pre-render     calculate at the full limit right away\n"
+            "  --cores N           1 leaves progressive passes to core1 alone (default 2)\n"
+            "  --out FILE          write the frame as binary PPM\n",
+            name);
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(arg, "--center") && i + 2 < argc) {
+            options.real = argv[++i];
+            options.imag = argv[++i];
+        } else if (!std::strcmp(arg, "--zoom") && has_value) {
+            options.zoom = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "--iterations") && has_value) {
+            options.iterations = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "--size") && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--mode") && has_value) {
+            const char* mode = argv[++i];
+            if (!std::strcmp(mode, "progressive")) {
+                options.mode = RENDER_PROGRESSIVE;
+            } else if (!std::strcmp(mode, "mariani")) {
+                options.mode = RENDER_MARIANI_SILVER;
+            } else {
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--no-pre-render")) {
+            options.pre_render = false;
+        } else if (!std::strcmp(arg, "--cores") && has_value) {
+            options.cores = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "--out") && has_value) {
+            options.out = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.zoom > 0 && (options.cores == 1 || options.cores == 2);
+}
+
+bool write_ppm(const FractalisState& state, int iter_limit, const palette::Equalization& equalization, const char* path) {
+    FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "P6\n%d %d\n255\n", state.screen_w, state.screen_h);
+    for (int y = 0; y < state.screen_h; ++y) {
+        for (int x = 0; x < state.screen_w; ++x) {
+            palette::Color color = {0, 0, 0};
+            if (state.isPixelComplete(x, y)) {
+                color = palette::pixel_color(state.at(x, y), iter_limit, equalization);
+            }
+            const unsigned char rgb[3] = {color.r, color.g, color.b};
+            std::fwrite(rgb, 1, 3, file);
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FractalisState state(options.width, options.height);
+    Fractalis fractalis(&state);
+    TileScheduler scheduler(&state);
+    Progressive progressive(&state, &fractalis, &scheduler);
+    MarianiSilver marianiSilver(&state, &fractalis);
+    state.center = {host::parse_decimal(options.real), host::parse_decimal(options.imag)};
+    state.zoom_factor = options.zoom;
+    state.render_mode = options.mode;
+
+    // Core0 of the pico: takes tiles while there are any and sends what was published every UPDATE_SLEEP ms
+    DirtyRegion dirty(options.width, options.height);
+    MockDisplayOutput output(options.width, options.height);
+    std::atomic<bool> done(false);
+    auto drain = [&]() {
+        ScreenRect rect;
+        for (RectQueue& queue : state.finished) {
+            while (queue.pop(rect)) {
+                dirty.add(rect);
+            }
+            if (queue.overflowed()) {
+                dirty.add_all();
+            }
+        }
+    };
+    auto flush = [&]() {
+        const Clock::time_point start = Clock::now();
+        dirty.flush(output);
+        stats::add_time(stats::FLUSH, std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+    };
+    std::thread core0([&]() {
+        Clock::time_point next_tick = Clock::now() + std::chrono::milliseconds(UPDATE_SLEEP);
+        while (!done.load()) {
+            if (Clock::now() >= next_tick) {
+                drain();
+                flush();
+                next_tick += std::chrono::milliseconds(UPDATE_SLEEP);
+            }
+            if (options.cores < 2 || !scheduler.help()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        drain();
+        flush();
+    });
+
+    const int iter_limit = options.iterations > 0 ? options.iterations : host::default_iteration_limit(options.zoom, options.width);
+    int limits[2] = {host::pre_render_limit(options.zoom, iter_limit), iter_limit};
+    const Clock::time_point start = Clock::now();
+    for (int pass = options.pre_render ? 0 : 1; pass < 2; ++pass) {
+        const Clock::time_point pass_start = Clock::now();
+        state.iteration_limit = limits[pass];
+        fractalis.begin_frame(limits[pass]);
+        if (options.mode == RENDER_PROGRESSIVE) {
+            progressive.render(limits[pass], state.calculation_id);
+        } else {
+            marianiSilver.render(limits[pass], state.calculation_id);
+        }
+        fractalis.finish_frame(limits[pass]);
+        const auto took = Clock::now() - pass_start;
+        printf("Pass: limit %d, %s, %.1f ms\n", limits[pass], host::tier_name(fractalis.get_tier()),
+               std::chrono::duration<double, std::milli>(took).count());
+        stats::add_time(stats::COMPUTE, std::chrono::duration_cast<std::chrono::microseconds>(took).count());
+        // The last pass is reported once its display updates are sent as well
+        if (pass == 0) {
+            stats::report();
+            state.resetUnfinishedPixels(limits[pass]);
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    done.store(true);
+    core0.join();
+    stats::report();
+
+    const int pixels = options.width * options.height;
+    printf("Frame: %dx%d, limit %d, %s, %d core(s): %.1f ms, %.2f Mpixel/s\n", options.width, options.height, iter_limit,
+           options.mode == RENDER_PROGRESSIVE ? "progressive" : "mariani", options.cores, seconds * 1000,
+           pixels / seconds / 1e6);
+    printf("Display: %d updates, %zu windows, %llu bytes, %llu with full updates\n", output.frames(),
+           output.transfers().size(), static_cast<unsigned long long>(output.bytes()),
+           static_cast<unsigned long long>(output.full_update_bytes()));
+
+    if (options.out) {
+        palette::Equalization equalization = {};
+        if (EQUALIZE_COLORS) {
+            palette::equalize(state.iterationHistogram(), iter_limit, equalization);
+        }
+        if (!write_ppm(state, iter_limit, equalization, options.out)) {
+            fprintf(stderr, "could not write %s\n", options.out);
+            return 1;
+        }
+    }
+    return 0;
+}
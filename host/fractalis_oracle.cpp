@@ -0,0 +1,267 @@
+//
+// Precision oracle: calculates views in every tier and compares the iteration counts to a DoubleDouble reference,
+// to check that the tier a frame selects resolves it. Prints CSV like fractalis_bench.
+//
+//   fractalis_oracle                    every view of the catalogue
+//   fractalis_oracle --sweep -2 0       one center from zoom 1 down, to see where each tier breaks
+//   fractalis_oracle --resume           pre-render and resume like core1, must match a direct render exactly
+//
+// spacing_ulps is the pixel spacing in ulps of the tier at the largest coordinate on screen, a tier is selected
+// while it is above Fractalis::ULP_MARGIN. Perturbation is the exception, it takes over below the margin of
+// DOUBLE and its spacing_ulps is in the precision of the stored reference orbit. Pixels near the boundary
+// escape a few iterations apart from rounding alone, a tier that can't resolve the view shows as a jump of
+// mismatched and escape_mismatched pixels.
+//
+
+#include "FractalisState.h"
+#include "fractalis.h"
+#include "globals.h"
+#include "host_util.h"
+#include "views.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int width = 160;
+    int height = 120;
+    const char* view = nullptr;
+    // Center of a sweep, nullptr for the catalogue
+    const char* sweep_real = nullptr;
+    const char* sweep_imag = nullptr;
+    double sweep_to = 1e20;
+    double sweep_step = 4.0;
+    bool resume = false;
+};
+
+// A pass over the whole screen, in rows, or pixel by pixel through the scalar kernel
+void calculate_pass(FractalisState& state, Fractalis& fractalis, int iter_limit, bool rows = true) {
+    fractalis.begin_frame(iter_limit);
+    for (int y = 0; y < state.screen_h; ++y) {
+        if (rows) {
+            fractalis.calculate_row(y, 0, state.screen_w - 1, iter_limit);
+            continue;
+        }
+        for (int x = 0; x < state.screen_w; ++x) {
+            fractalis.calculate_pixel(x, y, iter_limit);
+        }
+    }
+    fractalis.finish_frame(iter_limit);
+}
+
+std::vector<uint16_t> screen_iterations(const FractalisState& state) {
+    std::vector<uint16_t> iterations;
+    iterations.reserve(state.screen_w * state.screen_h);
+    for (int y = 0; y < state.screen_h; ++y) {
+        for (int x = 0; x < state.screen_w; ++x) {
+            iterations.push_back(state.at(x, y).iteration);
+        }
+    }
+    return iterations;
+}
+
+std::vector<uint16_t> calculate_frame(FractalisState& state, Fractalis& fractalis, PrecisionTier tier, int iter_limit,
+                                      bool rows = true) {
+    fractalis.force_tier(tier);
+    state.calculation_id++;
+    state.resetPixelComplete();
+    calculate_pass(state, fractalis, iter_limit, rows);
+    return screen_iterations(state);
+}
+
+// Pre-render at pre_limit, reset the pixels that reached it and continue their orbits at iter_limit, like core1
+// does. Resumed pixels have to come out like in a direct render. Pixels the pre-render finished are left out,
+// perturbation can finish them against another reference than a direct render
+int check_resume(const char* name, FractalisState& state, Fractalis& fractalis, PrecisionTier tier, int pre_limit,
+                 int iter_limit, bool rows) {
+    const std::vector<uint16_t> direct = calculate_frame(state, fractalis, tier, iter_limit, rows);
+    calculate_frame(state, fractalis, tier, pre_limit, rows);
+    state.resetUnfinishedPixels(pre_limit);
+    std::vector<bool> reset;
+    reset.reserve(direct.size());
+    for (int y = 0; y < state.screen_h; ++y) {
+        for (int x = 0; x < state.screen_w; ++x) {
+            reset.push_back(!state.isPixelComplete(x, y));
+        }
+    }
+    // The same calculation id, the orbit pool is kept
+    calculate_pass(state, fractalis, iter_limit, rows);
+    const std::vector<uint16_t> resumed = screen_iterations(state);
+
+    int differing = 0;
+    for (size_t i = 0; i < direct.size(); ++i) {
+        differing += reset[i] && direct[i] != resumed[i];
+    }
+    printf("resume,%s,%s,%s,%d,%d,%d\n", name, host::tier_name(tier), rows ? "row" : "pixel", pre_limit, iter_limit,
+           differing);
+    fflush(stdout);
+    fractalis.unforce_tier();
+    return differing;
+}
+
+struct Error {
+    // Pixels with another iteration count than the reference
+    double mismatched = 0;
+    // Pixels that escaped in one and not in the other
+    double escape_mismatched = 0;
+    // Iteration difference of pixels that escaped in both
+    double mean_difference = 0;
+    int max_difference = 0;
+};
+
+Error compare(const std::vector<uint16_t>& frame, const std::vector<uint16_t>& reference, int iter_limit) {
+    Error error;
+    long long difference_sum = 0;
+    int both_escaped = 0;
+    for (size_t i = 0; i < frame.size(); ++i) {
+        const bool escaped = frame[i] < iter_limit;
+        if (escaped != (reference[i] < iter_limit)) {
+            error.mismatched++;
+            error.escape_mismatched++;
+        } else if (escaped) {
+            const int difference = std::abs(frame[i] - reference[i]);
+            error.mismatched += difference != 0;
+            difference_sum += difference;
+            error.max_difference = std::max(error.max_difference, difference);
+            both_escaped++;
+        }
+    }
+    error.mismatched = 100.0 * error.mismatched / frame.size();
+    error.escape_mismatched = 100.0 * error.escape_mismatched / frame.size();
+    error.mean_difference = both_escaped ? static_cast<double>(difference_sum) / both_escaped : 0.0;
+    return error;
+}
+
+double spacing_ulps(Fractalis& fractalis, PrecisionTier tier) {
+    const double epsilon = host::tier_epsilon(tier);
+    return epsilon > 0 ? fractalis.spacing_in_ulps(epsilon) : NAN;
+}
+
+// Every tier but the reference itself against it, at the view state is set to
+void check_view(const char* name, FractalisState& state, Fractalis& fractalis, int iter_limit) {
+    fractalis.unforce_tier();
+    fractalis.begin_frame(iter_limit);
+    const PrecisionTier selected = fractalis.get_tier();
+    const std::vector<uint16_t> reference = calculate_frame(state, fractalis, PrecisionTier::DOUBLE_DOUBLE, iter_limit);
+
+    for (PrecisionTier tier : host::available_tiers()) {
+        if (tier == PrecisionTier::DOUBLE_DOUBLE) {
+            continue;
+        }
+        const Error error = compare(calculate_frame(state, fractalis, tier, iter_limit), reference, iter_limit);
+        printf("oracle,%s,%g,%d,%s,%d,%.4g,%.3f,%.3f,%.3f,%d\n", name, state.zoom_factor, iter_limit,
+               host::tier_name(tier), tier == selected, spacing_ulps(fractalis, tier), error.mismatched,
+               error.escape_mismatched, error.mean_difference, error.max_difference);
+        fflush(stdout);
+    }
+    fractalis.unforce_tier();
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --size WxH          screen size (default 160x120)\n"
+            "  --view NAME         only this view of the catalogue\n"
+            "  --sweep RE IM       zoom into this center instead of the catalogue, with the pico's iteration limits\n"
+            "  --to Z              last zoom of the sweep (default 1e20)\n"
+            "  --step F            zoom factor between the frames of the sweep (default 4)\n"
+            "  --resume            check resumed orbits instead, exits with 1 if a pixel differs\n"
+            "views:",
+            name);
+    for (const host::View& view : host::VIEWS) {
+        fprintf(stderr, " %s", view.name);
+    }
+    fprintf(stderr, "\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(arg, "--size") && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--view") && has_value) {
+            options.view = argv[++i];
+        } else if (!std::strcmp(arg, "--sweep") && i + 2 < argc) {
+            options.sweep_real = argv[++i];
+            options.sweep_imag = argv[++i];
+        } else if (!std::strcmp(arg, "--to") && has_value) {
+            options.sweep_to = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "--step") && has_value) {
+            options.sweep_step = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "--resume")) {
+            options.resume = true;
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.sweep_step > 1.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FractalisState state(options.width, options.height);
+    Fractalis fractalis(&state);
+
+    if (options.resume) {
+        printf("resume,view,tier,path,pre_limit,iter_limit,differing\n");
+        int differing = 0;
+        for (const host::View& view : host::VIEWS) {
+            if (options.view && std::strcmp(options.view, view.name)) {
+                continue;
+            }
+            state.center = {host::parse_decimal(view.real), host::parse_decimal(view.imag)};
+            state.zoom_factor = view.zoom;
+            for (PrecisionTier tier : host::available_tiers()) {
+                // Limits small enough that orbits escape in the last iteration of the pre-render
+                for (int pre_limit : {16, view.iter_limit / 6}) {
+                    for (bool rows : {false, true}) {
+                        differing += check_resume(view.name, state, fractalis, tier, pre_limit, view.iter_limit, rows);
+                    }
+                }
+            }
+        }
+        return differing ? 1 : 0;
+    }
+
+    printf("oracle,view,zoom,iter_limit,tier,selected,spacing_ulps,mismatched_pct,escape_mismatched_pct,"
+           "mean_difference,max_difference\n");
+
+    if (options.sweep_real) {
+        state.center = {host::parse_decimal(options.sweep_real), host::parse_decimal(options.sweep_imag)};
+        for (double zoom = 1.0; zoom <= options.sweep_to; zoom *= options.sweep_step) {
+            state.zoom_factor = zoom;
+            check_view("sweep", state, fractalis, host::default_iteration_limit(zoom, options.width));
+        }
+        return 0;
+    }
+
+    bool found = false;
+    for (const host::View& view : host::VIEWS) {
+        if (options.view && std::strcmp(options.view, view.name)) {
+            continue;
+        }
+        found = true;
+        state.center = {host::parse_decimal(view.real), host::parse_decimal(view.imag)};
+        state.zoom_factor = view.zoom;
+        check_view(view.name, state, fractalis, view.iter_limit);
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 2;
+    }
+    return 0;
+}
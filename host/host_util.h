@@ -0,0 +1,143 @@
+#ifndef HOST_UTIL_H
+#define HOST_UTIL_H
+
+// Helpers shared by the host tools: coordinates as text, the iteration limits the pico would pick and the tiers
+
+#include "doubledouble.h"
+#include "fractalis.h"
+#include "globals.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace host {
+
+// Digit by digit in DoubleDouble, deep zoom centers need more than the 17 digits strtod keeps
+inline DoubleDouble parse_decimal(const char* text) {
+    bool negative = *text == '-';
+    if (*text == '-' || *text == '+') {
+        text++;
+    }
+    DoubleDouble value(0.0);
+    int decimals = 0;
+    bool fraction = false;
+    for (; *text; ++text) {
+        if (*text == '.') {
+            fraction = true;
+            continue;
+        }
+        if (*text == 'e' || *text == 'E') {
+            decimals -= std::atoi(text + 1);
+            break;
+        }
+        if (*text < '0' || *text > '9') {
+            break;
+        }
+        value = value * 10.0 + static_cast<double>(*text - '0');
+        if (fraction) {
+            decimals++;
+        }
+    }
+    for (; decimals > 0; --decimals) {
+        value = value / 10.0;
+    }
+    for (; decimals < 0; ++decimals) {
+        value = value * 10.0;
+    }
+    return negative ? -value : value;
+}
+
+// The limit of update_iter_limit() on the pico
+inline int default_iteration_limit(double zoom, int width) {
+    double scale = width / (3.0 / zoom);
+    int max_iter = static_cast<int>(50 * std::pow(std::log10(scale), 1.25));
+    return std::max(LOWEST_ITER, std::min(max_iter, MAX_ITER));
+}
+
+// Pre-render limit of update_iter_limit() on the pico
+inline int pre_render_limit(double zoom, int iter_limit) {
+    int divider = 6;
+    if (zoom > 1e4)
+        divider -= 1;
+    if (zoom > 1e5)
+        divider -= 1;
+    return iter_limit / divider;
+}
+
+inline const char* tier_name(PrecisionTier tier) {
+    switch (tier) {
+        case PrecisionTier::FLOAT:
+            return "float";
+        case PrecisionTier::FLOAT_FLOAT:
+            return "float_float";
+        case PrecisionTier::FIXED32:
+            return "fixed32";
+        case PrecisionTier::FIXED64:
+            return "fixed64";
+        case PrecisionTier::DOUBLE:
+            return "double";
+        case PrecisionTier::DOUBLE_DOUBLE:
+            return "double_double";
+        case PrecisionTier::PERTURBATION:
+            return "perturbation";
+    }
+    return "unknown";
+}
+
+// Tiers of about the same resolution share a rank
+inline int tier_rank(PrecisionTier tier) {
+    switch (tier) {
+        case PrecisionTier::FLOAT:
+        case PrecisionTier::FIXED32:
+            return 0;
+        case PrecisionTier::FLOAT_FLOAT:
+        case PrecisionTier::FIXED64:
+            return 1;
+        case PrecisionTier::DOUBLE:
+            return 2;
+        case PrecisionTier::DOUBLE_DOUBLE:
+        case PrecisionTier::PERTURBATION:
+            return 3;
+    }
+    return 3;
+}
+
+// Relative precision of a tier, 0 for the fixed point tiers, whose precision is absolute. For perturbation it is
+// the one of the reference orbit as stored, double, the DoubleDouble it is calculated in is rounded away
+inline double tier_epsilon(PrecisionTier tier) {
+    switch (tier) {
+        case PrecisionTier::FLOAT:
+            return FLT_EPSILON;
+        case PrecisionTier::FLOAT_FLOAT:
+            return Fractalis::FLOAT_FLOAT_EPSILON;
+        case PrecisionTier::DOUBLE:
+        case PrecisionTier::PERTURBATION:
+            return DBL_EPSILON;
+        case PrecisionTier::DOUBLE_DOUBLE:
+            return DBL_EPSILON * DBL_EPSILON;
+        default:
+            return 0.0;
+    }
+}
+
+// The tiers this build has
+inline std::vector<PrecisionTier> available_tiers() {
+    std::vector<PrecisionTier> tiers = {PrecisionTier::FLOAT};
+    if (USE_FIXED_POINT) {
+        tiers.push_back(PrecisionTier::FIXED32);
+        tiers.push_back(PrecisionTier::FIXED64);
+    }
+    if (USE_FLOAT_FLOAT) {
+        tiers.push_back(PrecisionTier::FLOAT_FLOAT);
+    }
+    tiers.push_back(PrecisionTier::DOUBLE);
+    tiers.push_back(PrecisionTier::DOUBLE_DOUBLE);
+    tiers.push_back(PrecisionTier::PERTURBATION);
+    return tiers;
+}
+
+} // namespace host
+
+#endif // HOST_UTIL_H
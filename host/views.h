@@ -0,0 +1,34 @@
+#ifndef HOST_VIEWS_H
+#define HOST_VIEWS_H
+
+// Reference views of the host tools, the same for every run so results can be compared across changes
+
+namespace host {
+
+struct View {
+    const char* name;
+    const char* real;
+    const char* imag;
+    double zoom;
+    // Fixed instead of the pico's formula, so changing that doesn't change the results
+    int iter_limit;
+};
+
+// Seahorse valley point, precise to more digits than DoubleDouble has. It ends in a minibrot before 1e15, the
+// deeper views zoom into i instead, a Misiurewicz point which has escaping pixels next to it at any depth
+#define SEAHORSE_REAL "-0.743643887037158704752191506114774"
+#define SEAHORSE_IMAG "0.131825904205311970493132056385139"
+
+inline const View VIEWS[] = {
+    {"home", "-0.5", "0", 1.0, 256},
+    {"seahorse", "-0.743643887037151", "0.131825904205330", 1e4, 1000},
+    {"interior", "-0.122561166876654", "0.744861766619744", 25.0, 1000},  // Inside the period 3 bulb
+    {"tip_1e12", "-2", "0", 1e12, 1000},  // Largest coordinates of the set, the fewest bits left for the spacing
+    {"deep_1e10", SEAHORSE_REAL, SEAHORSE_IMAG, 1e10, 2000},
+    {"deep_1e15", "0", "1", 1e15, 3000},
+    {"deep_1e25", "0", "1", 1e25, 5000},
+};
+
+} // namespace host
+
+#endif // HOST_VIEWS_H
@@ -0,0 +1,238 @@
+//
+// Building blocks of the escape time kernel shared by all precision tiers.
+//
+// Fractalis::calculate_pixel_kernel<T, Policy> is written once against KernelNumber<T>, which tells it
+// how to build c for a pixel, what its constants are and how to test for escape in the number format T.
+// The policy switches the optional parts of the loop at compile time, so every instantiation is a
+// straight loop without per pixel or per iteration mode checks.
+//
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "FractalisState.h"
+#include "doubledouble.h"
+#include "floatfloat.h"
+#include "fixedpoint.h"
+#include <cmath>
+#include <cstdint>
+
+/**
+ * View geometry of one frame in every number format. c of pixel (x, y) is
+ * center + (x - center_x, y - center_y) * step, both axes share the same step.
+ */
+struct FrameGeometry {
+    // Fraction of the pixel spacing used as periodicity epsilon
+    static constexpr double PERIODICITY_TOLERANCE = 1.0 / 1024;
+
+    int center_x;
+    int center_y;
+    doubledouble::DoubleDouble dd_re, dd_im, dd_step;
+    double double_re, double_im, double_step;
+    float float_re, float_im, float_step;
+    floatfloat::FloatFloat ff_re, ff_im, ff_step;
+    // The step keeps 16 more bits in fixed_step_fraction, so the position of the last pixel is
+    // exact to well below one unit in the last place. Only meaningful while the view fits Q3.60.
+    fixedpoint::Fixed64 fixed_re, fixed_im;
+    int64_t fixed_step;
+    uint32_t fixed_step_fraction;
+    // Distance per component below which an orbit counts as having returned to an earlier point.
+    // Scales with the pixel spacing, so periodicity checking stays valid at any depth.
+    double periodicity_epsilon;
+
+    void update(const FractalisState& state)
+    {
+        center_x = state.screen_w / 2;
+        center_y = state.screen_h / 2;
+        dd_re = state.center.real + state.pan_real;
+        dd_im = state.center.imag + state.pan_imag;
+        dd_step = doubledouble::DoubleDouble(4.0) / state.zoom_factor / state.screen_w;
+        derive();
+    }
+
+    /** @brief Move the view by a fraction of a pixel, pixel (x, y) then is at (x + dx, y + dy) of the frame. */
+    void offset(double dx, double dy)
+    {
+        dd_re = dd_re + dd_step * dx;
+        dd_im = dd_im + dd_step * dy;
+        derive();
+    }
+
+private:
+    // Everything else from the DoubleDouble center and step
+    void derive()
+    {
+        double_re = dd_re.upper;
+        double_im = dd_im.upper;
+        double_step = dd_step.upper;
+        periodicity_epsilon = double_step * PERIODICITY_TOLERANCE;
+        float_re = static_cast<float>(double_re);
+        float_im = static_cast<float>(double_im);
+        float_step = static_cast<float>(double_step);
+        ff_re = floatfloat::FloatFloat(dd_re);
+        ff_im = floatfloat::FloatFloat(dd_im);
+        ff_step = floatfloat::FloatFloat(dd_step);
+
+        if (std::abs(double_re) < 4.0 && std::abs(double_im) < 4.0) {
+            fixed_re = fixedpoint::fixed64_from_dd(dd_re);
+            fixed_im = fixedpoint::fixed64_from_dd(dd_im);
+            double step = double_step / fixedpoint::Fixed64::epsilon;
+            fixed_step = static_cast<int64_t>(std::floor(step));
+            fixed_step_fraction = static_cast<uint32_t>((step - std::floor(step)) * 65536.0);
+        }
+    }
+};
+
+/**
+ * Compile time switches of the kernel.
+ * BULB_CHECK: skip points inside the main cardioid and period 2 bulb.
+ * PERIODICITY: stop orbits that returned to an earlier point.
+ * SMOOTHING: store the continuous iteration count for coloring.
+ * INTERIOR: track the derivative dz_n/dz_1 and stop orbits once it shrank below INTERIOR_THRESHOLD.
+ * It is the product of 2 * z_k along the orbit, it decays on an attracting cycle and grows on every
+ * other orbit. This finds the interior of minibrots long before the orbit settled within the
+ * periodicity epsilon.
+ */
+template <bool BulbCheck, bool Periodicity, bool Smoothing, bool Interior>
+struct KernelPolicy {
+    static constexpr bool BULB_CHECK = BulbCheck;
+    static constexpr bool PERIODICITY = Periodicity;
+    static constexpr bool SMOOTHING = Smoothing;
+    static constexpr bool INTERIOR = Interior;
+    // Bound of |dz_n/dz_1|^2
+    static constexpr double INTERIOR_THRESHOLD = 1e-12;
+};
+
+// Deep views rarely contain the main cardioid, but often minibrots. Near the main cardioid the bulb
+// check is cheaper than tracking the derivative
+using ShallowPolicy = KernelPolicy<true, true, true, false>;
+using DeepPolicy = KernelPolicy<false, true, true, true>;
+// The derivative of escaping orbits grows without bound, the fixed point formats can't hold it
+using DeepFixedPolicy = KernelPolicy<false, true, true, false>;
+
+/**
+ * Number format traits of the kernel.
+ * BOUNDED: the format overflows past |x| >= 8, so the kernel has to stop as soon as a component exceeds 2.
+ * real(), imag(): components of c of the pixel at (dx, dy) from the view center.
+ * dyadic(n, shift): n / 2^shift, for constants.
+ * escaped(): |z|^2 > 4, given the squared components.
+ * Derivative, derivative(): the format of the derivative for interior detection and the conversion to
+ * it. Its magnitude only gets compared against a threshold, so the native format of the same width does.
+ */
+template <typename T>
+struct KernelNumber;
+
+template <>
+struct KernelNumber<float> {
+    static constexpr bool BOUNDED = false;
+    static float real(const FrameGeometry& g, int dx) { return g.float_re + g.float_step * dx; }
+    static float imag(const FrameGeometry& g, int dy) { return g.float_im + g.float_step * dy; }
+    static float dyadic(int n, int shift) { return std::ldexp(static_cast<float>(n), -shift); }
+    static float from_double(double x) { return static_cast<float>(x); }
+    static double to_double(float x) { return x; }
+    static bool escaped(float zr2, float zi2) { return zr2 + zi2 > 4.0f; }
+    using Derivative = float;
+    static float derivative(float x) { return x; }
+};
+
+template <>
+struct KernelNumber<double> {
+    static constexpr bool BOUNDED = false;
+    static double real(const FrameGeometry& g, int dx) { return g.double_re + g.double_step * dx; }
+    static double imag(const FrameGeometry& g, int dy) { return g.double_im + g.double_step * dy; }
+    static double dyadic(int n, int shift) { return std::ldexp(static_cast<double>(n), -shift); }
+    static double from_double(double x) { return x; }
+    static double to_double(double x) { return x; }
+    static bool escaped(double zr2, double zi2) { return zr2 + zi2 > 4.0; }
+    using Derivative = double;
+    static double derivative(double x) { return x; }
+};
+
+// The upper parts are precise enough for the escape check
+template <>
+struct KernelNumber<floatfloat::FloatFloat> {
+    using FloatFloat = floatfloat::FloatFloat;
+    static constexpr bool BOUNDED = false;
+    static FloatFloat real(const FrameGeometry& g, int dx) { return g.ff_re + g.ff_step * static_cast<float>(dx); }
+    static FloatFloat imag(const FrameGeometry& g, int dy) { return g.ff_im + g.ff_step * static_cast<float>(dy); }
+    static FloatFloat dyadic(int n, int shift) { return FloatFloat(std::ldexp(static_cast<float>(n), -shift)); }
+    static FloatFloat from_double(double x) { return FloatFloat(x); }
+    static double to_double(const FloatFloat& x) { return x.to_double(); }
+    static bool escaped(const FloatFloat& zr2, const FloatFloat& zi2) { return zr2.upper + zi2.upper > 4.0f; }
+    using Derivative = float;
+    static float derivative(const FloatFloat& x) { return x.upper; }
+};
+
+template <>
+struct KernelNumber<doubledouble::DoubleDouble> {
+    using DoubleDouble = doubledouble::DoubleDouble;
+    static constexpr bool BOUNDED = false;
+    static DoubleDouble real(const FrameGeometry& g, int dx) { return g.dd_re + g.dd_step * static_cast<double>(dx); }
+    static DoubleDouble imag(const FrameGeometry& g, int dy) { return g.dd_im + g.dd_step * static_cast<double>(dy); }
+    static DoubleDouble dyadic(int n, int shift) { return DoubleDouble(std::ldexp(static_cast<double>(n), -shift)); }
+    static DoubleDouble from_double(double x) { return DoubleDouble(x); }
+    static double to_double(const DoubleDouble& x) { return x.upper + x.lower; }
+    static bool escaped(const DoubleDouble& zr2, const DoubleDouble& zi2) { return zr2.upper + zi2.upper > 4.0; }
+    using Derivative = double;
+    static double derivative(const DoubleDouble& x) { return x.upper; }
+};
+
+// Fixed32 takes the upper bits of the Q3.60 coordinates, the step is too fine for it to be built directly
+template <typename Raw, typename Wide, int FRACTION_BITS>
+struct KernelNumber<fixedpoint::Fixed<Raw, Wide, FRACTION_BITS>> {
+    using FixedT = fixedpoint::Fixed<Raw, Wide, FRACTION_BITS>;
+    using Fixed64 = fixedpoint::Fixed64;
+    static constexpr bool BOUNDED = true;
+    static FixedT real(const FrameGeometry& g, int dx) { return narrow(g.fixed_re + offset(g, dx)); }
+    static FixedT imag(const FrameGeometry& g, int dy) { return narrow(g.fixed_im + offset(g, dy)); }
+    static FixedT dyadic(int n, int shift) { return FixedT::from_raw(static_cast<Raw>(n) << (FRACTION_BITS - shift)); }
+    static FixedT from_double(double x) { return FixedT::from_raw(static_cast<Raw>(std::llround(x / FixedT::epsilon))); }
+    static double to_double(const FixedT& x) { return x.to_double(); }
+    // Subtracting keeps the comparison in range, zr2 + zi2 can reach 8
+    static bool escaped(const FixedT& zr2, const FixedT& zi2) { return zr2 > dyadic(4, 0) - zi2; }
+    // Only for completeness, the fixed point tiers don't track the derivative, see DeepFixedPolicy
+    using Derivative = float;
+    static float derivative(const FixedT& x) { return static_cast<float>(x.to_double()); }
+
+private:
+    static Fixed64 offset(const FrameGeometry& g, int64_t d)
+    {
+        return Fixed64::from_raw(d * g.fixed_step + ((d * g.fixed_step_fraction) >> 16));
+    }
+    static FixedT narrow(const Fixed64& x)
+    {
+        return FixedT::from_raw(static_cast<Raw>(x.raw >> (Fixed64::fraction_bits - FRACTION_BITS)));
+    }
+};
+
+/**
+ * @brief Store the result of an orbit in its pixel. Marking it complete in the state is up to the caller,
+ * samples that are no pixel of the screen use it as well.
+ * @param norm |z|^2 after the last iteration, only used for escaped orbits.
+ */
+template <bool Smoothing>
+inline void complete_pixel(PixelState& pixel, int iteration, int iter_limit, double norm)
+{
+    if (!Smoothing) {
+        pixel.setSmoothIterationFloat(static_cast<float>(iteration));
+    } else if (iteration < iter_limit) {
+        double log_zn = std::log(norm) / 4;
+        double nu = std::log(log_zn / std::log(2)) / std::log(2);
+        pixel.setSmoothIterationFloat(iteration + 1 - nu);
+    } else {
+        pixel.setSmoothIterationFloat(1.0f);
+    }
+
+    pixel.iteration = iteration;
+}
+
+/**
+ * @brief Store a pixel proven to be inside the set, by the bulb check, periodicity or its derivative.
+ */
+inline void complete_interior(PixelState& pixel)
+{
+    pixel.setSmoothIterationFloat(1.0f);
+    pixel.iteration = PixelState::INTERIOR;
+}
+
+#endif // KERNEL_H
@@ -0,0 +1,342 @@
+//
+// Lane vectors for the batched escape time kernel.
+//
+// A lane vector holds the same variable of several orbits, so one z = z^2 + c step advances all of
+// them. Independent orbits don't wait for each other's results, which hides the latency of the FPU.
+//
+// ScalarLanes<T, N> is a plain array that the compiler turns into interleaved scalar instructions, the
+// right thing for the Cortex-M33 and for FloatFloat. On x86 hosts float and double map to SSE or AVX
+// registers instead.
+//
+// Every operation is a lane wise IEEE operation in the same order as in the scalar kernel, so results
+// are bit identical to it.
+//
+
+#ifndef LANES_H
+#define LANES_H
+
+#include "kernel.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+template <typename T, int N>
+struct ScalarLanes {
+    static constexpr int SIZE = N;
+    T v[N];
+
+    static ScalarLanes broadcast(const T& x)
+    {
+        ScalarLanes r;
+        for (int i = 0; i < N; ++i) {
+            r.v[i] = x;
+        }
+        return r;
+    }
+    T get(int lane) const { return v[lane]; }
+    void set(int lane, const T& x) { v[lane] = x; }
+
+    ScalarLanes operator+(const ScalarLanes& x) const
+    {
+        ScalarLanes r;
+        for (int i = 0; i < N; ++i) {
+            r.v[i] = v[i] + x.v[i];
+        }
+        return r;
+    }
+    ScalarLanes operator-(const ScalarLanes& x) const
+    {
+        ScalarLanes r;
+        for (int i = 0; i < N; ++i) {
+            r.v[i] = v[i] - x.v[i];
+        }
+        return r;
+    }
+    ScalarLanes operator*(const ScalarLanes& x) const
+    {
+        ScalarLanes r;
+        for (int i = 0; i < N; ++i) {
+            r.v[i] = v[i] * x.v[i];
+        }
+        return r;
+    }
+
+    /** @brief Bit i is set if lane i escaped, given the squared components and, for bounded formats, z. */
+    static int escaped_mask(const ScalarLanes& zr, const ScalarLanes& zi, const ScalarLanes& zr2, const ScalarLanes& zi2)
+    {
+        using Number = KernelNumber<T>;
+        const T two = Number::dyadic(2, 0);
+        int mask = 0;
+        for (int i = 0; i < N; ++i) {
+            bool outside = Number::BOUNDED && (zr.v[i] > two || zr.v[i] < -two || zi.v[i] > two || zi.v[i] < -two);
+            if (outside || Number::escaped(zr2.v[i], zi2.v[i])) {
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+    }
+    /** @brief Bit i is set if both components of lane i are within +-epsilon. */
+    static int within_mask(const ScalarLanes& dr, const ScalarLanes& di, const T& epsilon)
+    {
+        int mask = 0;
+        for (int i = 0; i < N; ++i) {
+            if (dr.v[i] <= epsilon && -epsilon <= dr.v[i] && di.v[i] <= epsilon && -epsilon <= di.v[i]) {
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+    }
+    /** @brief Bit i is set if re^2 + im^2 of lane i is below the threshold. */
+    static int norm_below_mask(const ScalarLanes& re, const ScalarLanes& im, const T& threshold)
+    {
+        int mask = 0;
+        for (int i = 0; i < N; ++i) {
+            if (re.v[i] * re.v[i] + im.v[i] * im.v[i] < threshold) {
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+    }
+};
+
+#if defined(__AVX__)
+
+struct AvxDoubleLanes {
+    static constexpr int SIZE = 4;
+    __m256d v;
+
+    static AvxDoubleLanes broadcast(double x) { return {_mm256_set1_pd(x)}; }
+    double get(int lane) const
+    {
+        alignas(32) double lanes[SIZE];
+        _mm256_store_pd(lanes, v);
+        return lanes[lane];
+    }
+    void set(int lane, double x)
+    {
+        __m256d mask = _mm256_cmp_pd(_mm256_set1_pd(lane), _mm256_setr_pd(0, 1, 2, 3), _CMP_EQ_OQ);
+        v = _mm256_blendv_pd(v, _mm256_set1_pd(x), mask);
+    }
+
+    AvxDoubleLanes operator+(const AvxDoubleLanes& x) const { return {_mm256_add_pd(v, x.v)}; }
+    AvxDoubleLanes operator-(const AvxDoubleLanes& x) const { return {_mm256_sub_pd(v, x.v)}; }
+    AvxDoubleLanes operator*(const AvxDoubleLanes& x) const { return {_mm256_mul_pd(v, x.v)}; }
+
+    static int escaped_mask(const AvxDoubleLanes&, const AvxDoubleLanes&, const AvxDoubleLanes& zr2, const AvxDoubleLanes& zi2)
+    {
+        return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_add_pd(zr2.v, zi2.v), _mm256_set1_pd(4.0), _CMP_GT_OQ));
+    }
+    static int within_mask(const AvxDoubleLanes& dr, const AvxDoubleLanes& di, double epsilon)
+    {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        const __m256d eps = _mm256_set1_pd(epsilon);
+        __m256d r = _mm256_cmp_pd(_mm256_andnot_pd(sign, dr.v), eps, _CMP_LE_OQ);
+        __m256d i = _mm256_cmp_pd(_mm256_andnot_pd(sign, di.v), eps, _CMP_LE_OQ);
+        return _mm256_movemask_pd(_mm256_and_pd(r, i));
+    }
+    static int norm_below_mask(const AvxDoubleLanes& re, const AvxDoubleLanes& im, double threshold)
+    {
+        __m256d norm = _mm256_add_pd(_mm256_mul_pd(re.v, re.v), _mm256_mul_pd(im.v, im.v));
+        return _mm256_movemask_pd(_mm256_cmp_pd(norm, _mm256_set1_pd(threshold), _CMP_LT_OQ));
+    }
+};
+
+struct AvxFloatLanes {
+    static constexpr int SIZE = 8;
+    __m256 v;
+
+    static AvxFloatLanes broadcast(float x) { return {_mm256_set1_ps(x)}; }
+    float get(int lane) const
+    {
+        alignas(32) float lanes[SIZE];
+        _mm256_store_ps(lanes, v);
+        return lanes[lane];
+    }
+    void set(int lane, float x)
+    {
+        __m256 mask = _mm256_cmp_ps(_mm256_set1_ps(lane), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _CMP_EQ_OQ);
+        v = _mm256_blendv_ps(v, _mm256_set1_ps(x), mask);
+    }
+
+    AvxFloatLanes operator+(const AvxFloatLanes& x) const { return {_mm256_add_ps(v, x.v)}; }
+    AvxFloatLanes operator-(const AvxFloatLanes& x) const { return {_mm256_sub_ps(v, x.v)}; }
+    AvxFloatLanes operator*(const AvxFloatLanes& x) const { return {_mm256_mul_ps(v, x.v)}; }
+
+    static int escaped_mask(const AvxFloatLanes&, const AvxFloatLanes&, const AvxFloatLanes& zr2, const AvxFloatLanes& zi2)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(zr2.v, zi2.v), _mm256_set1_ps(4.0f), _CMP_GT_OQ));
+    }
+    static int within_mask(const AvxFloatLanes& dr, const AvxFloatLanes& di, float epsilon)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 eps = _mm256_set1_ps(epsilon);
+        __m256 r = _mm256_cmp_ps(_mm256_andnot_ps(sign, dr.v), eps, _CMP_LE_OQ);
+        __m256 i = _mm256_cmp_ps(_mm256_andnot_ps(sign, di.v), eps, _CMP_LE_OQ);
+        return _mm256_movemask_ps(_mm256_and_ps(r, i));
+    }
+    static int norm_below_mask(const AvxFloatLanes& re, const AvxFloatLanes& im, float threshold)
+    {
+        __m256 norm = _mm256_add_ps(_mm256_mul_ps(re.v, re.v), _mm256_mul_ps(im.v, im.v));
+        return _mm256_movemask_ps(_mm256_cmp_ps(norm, _mm256_set1_ps(threshold), _CMP_LT_OQ));
+    }
+};
+
+#elif defined(__SSE2__)
+
+struct SseDoubleLanes {
+    static constexpr int SIZE = 2;
+    __m128d v;
+
+    static SseDoubleLanes broadcast(double x) { return {_mm_set1_pd(x)}; }
+    double get(int lane) const
+    {
+        alignas(16) double lanes[SIZE];
+        _mm_store_pd(lanes, v);
+        return lanes[lane];
+    }
+    void set(int lane, double x)
+    {
+        __m128d mask = _mm_cmpeq_pd(_mm_set1_pd(lane), _mm_setr_pd(0, 1));
+        v = _mm_or_pd(_mm_andnot_pd(mask, v), _mm_and_pd(mask, _mm_set1_pd(x)));
+    }
+
+    SseDoubleLanes operator+(const SseDoubleLanes& x) const { return {_mm_add_pd(v, x.v)}; }
+    SseDoubleLanes operator-(const SseDoubleLanes& x) const { return {_mm_sub_pd(v, x.v)}; }
+    SseDoubleLanes operator*(const SseDoubleLanes& x) const { return {_mm_mul_pd(v, x.v)}; }
+
+    static int escaped_mask(const SseDoubleLanes&, const SseDoubleLanes&, const SseDoubleLanes& zr2, const SseDoubleLanes& zi2)
+    {
+        return _mm_movemask_pd(_mm_cmpgt_pd(_mm_add_pd(zr2.v, zi2.v), _mm_set1_pd(4.0)));
+    }
+    static int within_mask(const SseDoubleLanes& dr, const SseDoubleLanes& di, double epsilon)
+    {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        const __m128d eps = _mm_set1_pd(epsilon);
+        __m128d r = _mm_cmple_pd(_mm_andnot_pd(sign, dr.v), eps);
+        __m128d i = _mm_cmple_pd(_mm_andnot_pd(sign, di.v), eps);
+        return _mm_movemask_pd(_mm_and_pd(r, i));
+    }
+    static int norm_below_mask(const SseDoubleLanes& re, const SseDoubleLanes& im, double threshold)
+    {
+        __m128d norm = _mm_add_pd(_mm_mul_pd(re.v, re.v), _mm_mul_pd(im.v, im.v));
+        return _mm_movemask_pd(_mm_cmplt_pd(norm, _mm_set1_pd(threshold)));
+    }
+};
+
+struct SseFloatLanes {
+    static constexpr int SIZE = 4;
+    __m128 v;
+
+    static SseFloatLanes broadcast(float x) { return {_mm_set1_ps(x)}; }
+    float get(int lane) const
+    {
+        alignas(16) float lanes[SIZE];
+        _mm_store_ps(lanes, v);
+        return lanes[lane];
+    }
+    void set(int lane, float x)
+    {
+        __m128 mask = _mm_cmpeq_ps(_mm_set1_ps(lane), _mm_setr_ps(0, 1, 2, 3));
+        v = _mm_or_ps(_mm_andnot_ps(mask, v), _mm_and_ps(mask, _mm_set1_ps(x)));
+    }
+
+    SseFloatLanes operator+(const SseFloatLanes& x) const { return {_mm_add_ps(v, x.v)}; }
+    SseFloatLanes operator-(const SseFloatLanes& x) const { return {_mm_sub_ps(v, x.v)}; }
+    SseFloatLanes operator*(const SseFloatLanes& x) const { return {_mm_mul_ps(v, x.v)}; }
+
+    static int escaped_mask(const SseFloatLanes&, const SseFloatLanes&, const SseFloatLanes& zr2, const SseFloatLanes& zi2)
+    {
+        return _mm_movemask_ps(_mm_cmpgt_ps(_mm_add_ps(zr2.v, zi2.v), _mm_set1_ps(4.0f)));
+    }
+    static int within_mask(const SseFloatLanes& dr, const SseFloatLanes& di, float epsilon)
+    {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 eps = _mm_set1_ps(epsilon);
+        __m128 r = _mm_cmple_ps(_mm_andnot_ps(sign, dr.v), eps);
+        __m128 i = _mm_cmple_ps(_mm_andnot_ps(sign, di.v), eps);
+        return _mm_movemask_ps(_mm_and_ps(r, i));
+    }
+    static int norm_below_mask(const SseFloatLanes& re, const SseFloatLanes& im, float threshold)
+    {
+        __m128 norm = _mm_add_ps(_mm_mul_ps(re.v, re.v), _mm_mul_ps(im.v, im.v));
+        return _mm_movemask_ps(_mm_cmplt_ps(norm, _mm_set1_ps(threshold)));
+    }
+};
+
+#endif
+
+/**
+ * @brief Lane wise conversion to the derivative format of KernelNumber<T>, the SIMD lane vectors
+ * already are in it.
+ */
+template <typename T, int N>
+ScalarLanes<typename KernelNumber<T>::Derivative, N> derivative_lanes(const ScalarLanes<T, N>& x)
+{
+    ScalarLanes<typename KernelNumber<T>::Derivative, N> r;
+    for (int i = 0; i < N; ++i) {
+        r.v[i] = KernelNumber<T>::derivative(x.v[i]);
+    }
+    return r;
+}
+
+#if defined(__AVX__)
+inline const AvxDoubleLanes& derivative_lanes(const AvxDoubleLanes& x) { return x; }
+inline const AvxFloatLanes& derivative_lanes(const AvxFloatLanes& x) { return x; }
+#elif defined(__SSE2__)
+inline const SseDoubleLanes& derivative_lanes(const SseDoubleLanes& x) { return x; }
+inline const SseFloatLanes& derivative_lanes(const SseFloatLanes& x) { return x; }
+#endif
+
+/**
+ * Lane vector type of a number format. BATCHED is false for formats whose operations are integer or
+ * library call sequences without FPU latency to hide, they are calculated one pixel after the other.
+ */
+template <typename T>
+struct LaneVector {
+    static constexpr bool BATCHED = false;
+    using type = ScalarLanes<T, 1>;
+};
+
+template <>
+struct LaneVector<floatfloat::FloatFloat> {
+    static constexpr bool BATCHED = true;
+    using type = ScalarLanes<floatfloat::FloatFloat, 4>;
+};
+
+#if defined(__AVX__)
+template <>
+struct LaneVector<double> {
+    static constexpr bool BATCHED = true;
+    using type = AvxDoubleLanes;
+};
+template <>
+struct LaneVector<float> {
+    static constexpr bool BATCHED = true;
+    using type = AvxFloatLanes;
+};
+#elif defined(__SSE2__)
+template <>
+struct LaneVector<double> {
+    static constexpr bool BATCHED = true;
+    using type = SseDoubleLanes;
+};
+template <>
+struct LaneVector<float> {
+    static constexpr bool BATCHED = true;
+    using type = SseFloatLanes;
+};
+#else
+template <>
+struct LaneVector<double> {
+    static constexpr bool BATCHED = true;
+    using type = ScalarLanes<double, 4>;
+};
+template <>
+struct LaneVector<float> {
+    static constexpr bool BATCHED = true;
+    using type = ScalarLanes<float, 4>;
+};
+#endif
+
+#endif // LANES_H
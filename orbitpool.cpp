@@ -0,0 +1,33 @@
+#include "orbitpool.h"
+#include <algorithm>
+
+OrbitPool::OrbitPool()
+    : count(0), sorted(0), format(nullptr), calculation_id(0), tier(-1) {}
+
+void OrbitPool::begin_frame(uint8_t calculation_id, int tier, const void* format) {
+    this->format = format;
+    if (calculation_id != this->calculation_id || tier != this->tier) {
+        this->calculation_id = calculation_id;
+        this->tier = tier;
+        count = 0;
+        sorted = 0;
+        return;
+    }
+
+    Snapshot* saved = snapshots + std::min(count.load(), RESUME_POOL_SIZE);
+    Snapshot* end = std::remove_if(snapshots, saved, [](const Snapshot& s) { return s.iteration == FREE; });
+    std::sort(snapshots, end, [](const Snapshot& a, const Snapshot& b) { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+    sorted = static_cast<int>(end - snapshots);
+    count = sorted;
+}
+
+int OrbitPool::find_slot(int x, int y) const {
+    const Snapshot* end = snapshots + sorted;
+    const Snapshot* it = std::lower_bound(snapshots, end, std::make_pair(y, x), [](const Snapshot& s, const std::pair<int, int>& p) {
+        return s.y != p.first ? s.y < p.first : s.x < p.second;
+    });
+    if (it == end || it->x != x || it->y != y || it->iteration == FREE) {
+        return -1;
+    }
+    return static_cast<int>(it - snapshots);
+}
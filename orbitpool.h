@@ -0,0 +1,118 @@
+//
+// Orbits that reached the iteration limit, kept to continue them once the limit is raised.
+//
+// A pixel that reached the limit is undecided, unlike one that escaped or was proven to be interior.
+// With its z, iteration count and derivative saved, the next pass at a higher limit only costs the
+// additional iterations. The pool is bounded, pixels that don't fit are iterated from zero again.
+// Snapshots are only valid for the view and number format they were saved in.
+//
+
+#ifndef ORBITPOOL_H
+#define ORBITPOOL_H
+
+#include "globals.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+class OrbitPool {
+public:
+    OrbitPool();
+
+    /**
+     * @brief Drop all snapshots if the calculation id or the tier changed since the last frame,
+     * otherwise make the snapshots of the last frame available to find(). Snapshots of the frame are in
+     * format T, the format is only written here, before either core calculates a pixel.
+     */
+    template <typename T>
+    void begin_frame(uint8_t calculation_id, int tier)
+    {
+        begin_frame(calculation_id, tier, format_tag<T>());
+    }
+
+    /** @brief Slot of the snapshot of pixel (x, y) in format T, -1 if there is none. */
+    template <typename T>
+    int find(int x, int y) const
+    {
+        return sorted > 0 && format == format_tag<T>() ? find_slot(x, y) : -1;
+    }
+
+    /** @brief Restore the orbit of a slot returned by find(). The slot is free for save() afterwards. */
+    template <typename T>
+    void load(int slot, int& iteration, T& zr, T& zi, double& der_r, double& der_i)
+    {
+        Snapshot& snapshot = snapshots[slot];
+        iteration = snapshot.iteration;
+        std::memcpy(&zr, snapshot.zr, sizeof(T));
+        std::memcpy(&zi, snapshot.zi, sizeof(T));
+        der_r = snapshot.der_r;
+        der_i = snapshot.der_i;
+        snapshot.iteration = FREE;
+    }
+
+    /**
+     * @brief Keep the orbit of pixel (x, y) that stopped at the iteration limit. Both cores may save at once, they only
+     * read the format begin_frame() set.
+     * @param slot The slot it was loaded from, -1 for a pixel iterated from zero.
+     */
+    template <typename T>
+    void save(int slot, int x, int y, int iteration, const T& zr, const T& zi, double der_r, double der_i)
+    {
+        static_assert(sizeof(T) <= sizeof(Snapshot::zr), "number format too large for a snapshot");
+        // E.g. the DoubleDouble fallback for glitches in a perturbation frame
+        if (format != format_tag<T>()) {
+            return;
+        }
+        if (slot < 0) {
+            // Claimed atomically, count runs past the size once the pool is full and is clamped in begin_frame()
+            slot = count.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= RESUME_POOL_SIZE) {
+                return;
+            }
+        }
+
+        Snapshot& snapshot = snapshots[slot];
+        snapshot.x = static_cast<int16_t>(x);
+        snapshot.y = static_cast<int16_t>(y);
+        snapshot.iteration = iteration;
+        std::memcpy(snapshot.zr, &zr, sizeof(T));
+        std::memcpy(snapshot.zi, &zi, sizeof(T));
+        snapshot.der_r = der_r;
+        snapshot.der_i = der_i;
+    }
+
+private:
+    static constexpr int32_t FREE = -1;
+
+    struct Snapshot {
+        int16_t x;
+        int16_t y;
+        int32_t iteration;
+        // z in the number format of the frame, at most two doubles per component
+        alignas(8) unsigned char zr[16];
+        alignas(8) unsigned char zi[16];
+        double der_r;
+        double der_i;
+    };
+
+    Snapshot snapshots[RESUME_POOL_SIZE];
+    std::atomic<int> count;
+    // snapshots[0, sorted) are ordered by position, the ones saved during this frame follow
+    int sorted;
+    const void* format;
+    uint8_t calculation_id;
+    int tier;
+
+    // One distinct address per number format
+    template <typename T>
+    static const void* format_tag()
+    {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    void begin_frame(uint8_t calculation_id, int tier, const void* format);
+    int find_slot(int x, int y) const;
+};
+
+#endif // ORBITPOOL_H
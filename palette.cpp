@@ -0,0 +1,94 @@
+#include "palette.h"
+#include "globals.h"
+#include <algorithm>
+#include <cmath>
+
+namespace palette {
+
+Color from_hsv(float h, float s, float v) {
+    float i = std::floor(h * 6.0f);
+    float f = h * 6.0f - i;
+    v *= 255.0f;
+    uint8_t value = static_cast<uint8_t>(v);
+    uint8_t p = static_cast<uint8_t>(v * (1.0f - s));
+    uint8_t q = static_cast<uint8_t>(v * (1.0f - f * s));
+    uint8_t t = static_cast<uint8_t>(v * (1.0f - (1.0f - f) * s));
+
+    switch (static_cast<int>(i) % 6) {
+        case 0: return {value, t, p};
+        case 1: return {q, value, p};
+        case 2: return {p, value, t};
+        case 3: return {p, q, value};
+        case 4: return {t, p, value};
+        case 5: return {value, p, q};
+        default: return {0, 0, 0};
+    }
+}
+
+Color table[BUCKETS];
+
+namespace {
+
+Params current;
+
+void build_table(const Params& params) {
+    current = params;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        table[bucket] = bucket_color(bucket, params);
+    }
+}
+
+const bool table_built = (build_table({static_cast<float>(START_HUE), SATURATION_THRESHOLD, VALUE_THRESHOLD}), true);
+
+} // namespace
+
+void set_params(const Params& params) {
+    if (!(params == current)) {
+        build_table(params);
+    }
+}
+
+const Params& params() {
+    return current;
+}
+
+void equalize(const std::atomic<uint32_t>* histogram, int iter_limit, Equalization& equalization) {
+    // The bucket of the limit holds the black pixels that reached it
+    const int limit_bucket = FractalisState::histogramBucket(std::min(iter_limit, PixelState::INTERIOR - 1));
+    uint32_t counts[FractalisState::HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (int bucket = 0; bucket < limit_bucket; ++bucket) {
+        counts[bucket] = histogram[bucket].load(std::memory_order_relaxed);
+        total += counts[bucket];
+    }
+
+    const uint64_t last = BUCKETS - 1;
+    uint64_t cumulative = 0;
+    for (int bucket = 0; bucket < FractalisState::HISTOGRAM_BUCKETS; ++bucket) {
+        if (bucket >= limit_bucket || total == 0) {
+            equalization.bucket_base[bucket] = bucket >= limit_bucket ? last : 0;
+            equalization.bucket_span[bucket] = 0;
+            continue;
+        }
+        equalization.bucket_base[bucket] = static_cast<uint16_t>(cumulative * last / total);
+        cumulative += counts[bucket];
+        equalization.bucket_span[bucket] =
+            static_cast<uint16_t>(cumulative * last / total - equalization.bucket_base[bucket]);
+    }
+}
+
+Color bucket_color(int bucket, const Params& params) {
+    float iteration_ratio;
+    if (EQUALIZE_COLORS) {
+        iteration_ratio = static_cast<float>(bucket) / (BUCKETS - 1) * EQUALIZED_HUE_CYCLES;
+    } else {
+        const float smooth = ((bucket << BUCKET_SHIFT) + (1 << BUCKET_SHIFT) / 2) / SMOOTH_ITER_SCALE;
+        iteration_ratio = std::log(1 + smooth) / 2.0f;
+    }
+    float hue = fmodf(params.start_hue + iteration_ratio, 1.0f);
+    float saturation = std::min(iteration_ratio / params.saturation_threshold, 1.0f);
+    float value = std::min(iteration_ratio / params.value_threshold, 1.0f);
+    return from_hsv(hue, saturation, value);
+}
+
+} // namespace
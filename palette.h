@@ -0,0 +1,113 @@
+//
+// Coloring of calculated pixels.
+//
+// The RGB conversion is the one pimoroni::RGB::from_hsv does for PicoGraphics::create_pen_hsv(), so
+// colors computed here, e.g. averaged for antialiasing, match the pens of the renderer exactly.
+//
+// Pixels are colored from a table with one color per bucket of smooth iteration counts. It is built from
+// the palette parameters once and again only when they change, a pixel costs a lookup instead of a
+// logarithm and a HSV conversion.
+//
+// With EQUALIZE_COLORS the table is indexed by the share of colored pixels with a lower iteration count
+// instead, taken from the histogram FractalisState keeps. equalize() turns it into a position per histogram
+// bucket, which costs a pass over the buckets, not over the screen. Each core that colors pixels keeps its
+// own Equalization, equalize() rewrites it while pixel_color() would read it otherwise.
+//
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "FractalisState.h"
+#include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace palette {
+
+struct Color {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+struct Params {
+    float start_hue;
+    float saturation_threshold;
+    float value_threshold;
+
+    bool operator==(const Params& other) const
+    {
+        return start_hue == other.start_hue && saturation_threshold == other.saturation_threshold &&
+               value_threshold == other.value_threshold;
+    }
+};
+
+// Smooth iteration counts per bucket, 1/64 of an iteration. 4096 buckets cover the whole uint16_t range
+constexpr int BUCKET_SHIFT = 4;
+constexpr int BUCKETS = 65536 >> BUCKET_SHIFT;
+
+/**
+ * @brief Convert hue, saturation and value, each in 0..1, to RGB.
+ */
+Color from_hsv(float h, float s, float v);
+
+/**
+ * @brief Color the pixels with params from now on. The table is only rebuilt if they differ from the current ones.
+ */
+void set_params(const Params& params);
+const Params& params();
+
+/**
+ * @brief Color of a table entry, computed without the table.
+ */
+Color bucket_color(int bucket, const Params& params);
+
+// Table entry of the first iteration of each histogram bucket and the entries the bucket spans, see equalize()
+struct Equalization {
+    uint16_t bucket_base[FractalisState::HISTOGRAM_BUCKETS];
+    uint16_t bucket_span[FractalisState::HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief Spread the table over the colored pixels of histogram into equalization, see
+ * FractalisState::iterationHistogram(). Pixels in the bucket of iter_limit or above get the last color.
+ */
+void equalize(const std::atomic<uint32_t>* histogram, int iter_limit, Equalization& equalization);
+
+// Built for START_HUE, SATURATION_THRESHOLD and VALUE_THRESHOLD before main() runs
+extern Color table[BUCKETS];
+
+inline int equalized_entry(const PixelState& pixel, const Equalization& equalization)
+{
+    int fraction;
+    if (pixel.iteration < 32) {
+        // A bucket per iteration, the smooth count tells where in it the orbit escaped
+        const int escaped = static_cast<int>(pixel.smooth_iteration) - (pixel.iteration << 10);
+        fraction = std::min(std::max(escaped, 0), 1023) >> 2;
+    } else {
+        const int shift = 31 - __builtin_clz(pixel.iteration) - 4;
+        fraction = ((pixel.iteration << 8) >> shift) & 0xFF;
+    }
+    const int bucket = FractalisState::histogramBucket(pixel.iteration);
+    return equalization.bucket_base[bucket] + ((equalization.bucket_span[bucket] * fraction) >> 8);
+}
+
+/**
+ * @brief Color of a completed pixel from its smooth iteration count, black for pixels at the iteration limit.
+ * equalization is only used with EQUALIZE_COLORS.
+ */
+inline Color pixel_color(const PixelState& pixel, int iter_limit, const Equalization& equalization)
+{
+    if (pixel.iteration >= iter_limit) {
+        return {0, 0, 0};
+    }
+    if (EQUALIZE_COLORS) {
+        return table[equalized_entry(pixel, equalization)];
+    }
+    return table[pixel.smooth_iteration >> BUCKET_SHIFT];
+}
+
+} // namespace
+
+#endif // PALETTE_H
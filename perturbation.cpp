@@ -0,0 +1,245 @@
+#include "perturbation.h"
+#include "kernel.h"
+#include "orbitpool.h"
+#include "stats.h"
+#include <cmath>
+#include <cfloat>
+
+Perturbation::Perturbation(FractalisState* state, OrbitPool* orbit_pool)
+    : state(state), orbit_pool(orbit_pool), primary_reference(true), orbit_size(0), ref_x(0), ref_y(0), pixel_step(0), series_skip(0),
+      glitched(false), glitch_x(0), glitch_y(0), glitch_metric(DBL_MAX) {}
+
+void Perturbation::begin_frame(int iter_limit) {
+    pixel_step = 4.0 / state->zoom_factor / state->screen_w;
+    ref_x = state->screen_w / 2.0;
+    ref_y = state->screen_h / 2.0;
+    primary_reference = true;
+    glitched = false;
+    glitch_metric = DBL_MAX;
+
+    compute_reference(state->center.real + state->pan_real, state->center.imag + state->pan_imag, iter_limit);
+    compute_series(iter_limit);
+    printf("Perturbation: reference orbit of %d iterations, series approximation skips %d\n", orbit_size, series_skip);
+}
+
+bool Perturbation::rebase(int iter_limit) {
+    if (!glitched) {
+        return false;
+    }
+
+    ref_x = glitch_x;
+    ref_y = glitch_y;
+    DoubleDouble re = state->center.real + state->pan_real + DoubleDouble((glitch_x - state->screen_w / 2.0) * pixel_step);
+    DoubleDouble im = state->center.imag + state->pan_imag + DoubleDouble((glitch_y - state->screen_h / 2.0) * pixel_step);
+    compute_reference(re, im, iter_limit);
+    primary_reference = false;
+    series_skip = 0;
+    series_derivative = 1.0;
+
+    glitched = false;
+    glitch_metric = DBL_MAX;
+    return true;
+}
+
+void Perturbation::compute_reference(const DoubleDouble& re, const DoubleDouble& im, int iter_limit) {
+    if (static_cast<int>(orbit.size()) < iter_limit) {
+        // Exactly the limit, resize() alone could double the capacity
+        orbit.reserve(iter_limit);
+        orbit.resize(iter_limit);
+    }
+
+    DoubleDouble zr(0), zi(0);
+    orbit_size = 0;
+    for (int n = 0; n < iter_limit; ++n) {
+        orbit[n] = std::complex<double>(zr.upper, zi.upper);
+        orbit_size = n + 1;
+        // The escaped value is still stored, pixels can use it for their own escape check
+        if (zr.upper * zr.upper + zi.upper * zi.upper > 4.0) {
+            break;
+        }
+        DoubleDouble zr2 = zr * zr;
+        DoubleDouble zi2 = zi * zi;
+        zi = (zr + zr) * zi + im;
+        zr = zr2 - zi2 + re;
+    }
+}
+
+void Perturbation::compute_series(int iter_limit) {
+    // Probe the corners and edge centers of the screen. They have the largest |dc|, so if the series
+    // matches the directly iterated delta there, it does for every pixel in between.
+    constexpr int PROBES = 8;
+    const double half_w = state->screen_w / 2.0;
+    const double half_h = state->screen_h / 2.0;
+    const double probe_x[PROBES] = {-half_w, 0, half_w, -half_w, half_w, -half_w, 0, half_w};
+    const double probe_y[PROBES] = {-half_h, -half_h, -half_h, 0, 0, half_h, half_h, half_h};
+    std::complex<double> dc[PROBES];
+    std::complex<double> dz[PROBES];
+    for (int i = 0; i < PROBES; ++i) {
+        dc[i] = std::complex<double>(probe_x[i] * pixel_step, probe_y[i] * pixel_step);
+        dz[i] = 0;
+    }
+
+    std::complex<double> a(0, 0), b(0, 0), c(0, 0);
+    std::complex<double> derivative(1, 0);
+    series_skip = 0;
+    series_derivative = derivative;
+    for (int n = 0; n + 1 < orbit_size && n + 1 < iter_limit; ++n) {
+        const std::complex<double>& Z = orbit[n];
+        const std::complex<double>& Z_next = orbit[n + 1];
+        const std::complex<double> next_a = 2.0 * Z * a + 1.0;
+        const std::complex<double> next_b = 2.0 * Z * b + a * a;
+        const std::complex<double> next_c = 2.0 * Z * c + 2.0 * a * b;
+
+        bool valid = true;
+        for (int i = 0; i < PROBES; ++i) {
+            dz[i] = (2.0 * Z + dz[i]) * dz[i] + dc[i];
+            const std::complex<double> series = ((next_c * dc[i] + next_b) * dc[i] + next_a) * dc[i];
+            const double z_norm = std::norm(Z_next + dz[i]);
+            if (std::norm(series - dz[i]) > SERIES_TOLERANCE * SERIES_TOLERANCE * std::norm(dz[i])
+                || z_norm > 4.0 || z_norm < GLITCH_TOLERANCE * std::norm(Z_next)) {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid) {
+            break;
+        }
+
+        a = next_a;
+        b = next_b;
+        c = next_c;
+        if (n > 0) {
+            derivative *= 2.0 * Z;
+        }
+        series_skip = n + 1;
+        series_derivative = derivative;
+    }
+    series_a = a;
+    series_b = b;
+    series_c = c;
+}
+
+// Both cores calculate pixels of a frame, the candidate is only read by rebase() once they are done
+void Perturbation::mark_glitch(int x, int y, double metric) {
+    while (glitch_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    glitched = true;
+    if (metric < glitch_metric) {
+        glitch_metric = metric;
+        glitch_x = x;
+        glitch_y = y;
+    }
+    glitch_lock.clear(std::memory_order_release);
+}
+
+void Perturbation::calculate_pixel(int x, int y, int iter_limit) {
+    if (x < 0 || x >= state->screen_w || y < 0 || y >= state->screen_h) {
+        return;
+    }
+    if (state->isPixelComplete(x, y)) {
+        return;
+    }
+
+    double metric;
+    if (iterate((x - ref_x) * pixel_step, (y - ref_y) * pixel_step, iter_limit, state->at(x, y), metric, x, y)) {
+        state->setPixelComplete(x, y);
+    } else {
+        mark_glitch(x, y, metric);
+    }
+}
+
+bool Perturbation::calculate_sample(double x, double y, int iter_limit, PixelState& sample) {
+    double metric;
+    return iterate((x - ref_x) * pixel_step, (y - ref_y) * pixel_step, iter_limit, sample, metric, -1, -1);
+}
+
+// Snapshots in the orbit pool are deltas to the reference at the view center. It is the same orbit in
+// every frame of a view, so they can be continued in the next one
+bool Perturbation::iterate(double dcr, double dci, int iter_limit, PixelState& pixel, double& glitch_metric, int x, int y) {
+    double dzr = 0;
+    double dzi = 0;
+    int iteration = 0;
+    // dz_n/dz_1 for interior detection, see KernelPolicy. Skipped iterations take it from the reference,
+    // the pixel's orbit is close to it for as long as the series approximation holds
+    double der_r = 1;
+    double der_i = 0;
+
+    const bool pooled = x >= 0 && primary_reference;
+    const int slot = pooled ? orbit_pool->find<double>(x, y) : -1;
+    int saved_iteration = 0;
+    if (slot >= 0) {
+        orbit_pool->load(slot, saved_iteration, dzr, dzi, der_r, der_i);
+    }
+    // The series of a pass with a lower limit stops at that limit. A snapshot the series of this pass reaches
+    // past is dropped, continuing it would take another path than a direct render
+    if (saved_iteration > series_skip) {
+        iteration = saved_iteration;
+    } else if (series_skip > 0) {
+        const std::complex<double> dc(dcr, dci);
+        const std::complex<double> dz = ((series_c * dc + series_b) * dc + series_a) * dc;
+        dzr = dz.real();
+        dzi = dz.imag();
+        iteration = series_skip;
+        der_r = series_derivative.real();
+        der_i = series_derivative.imag();
+    } else {
+        dzr = 0;
+        dzi = 0;
+        der_r = 1;
+        der_i = 0;
+    }
+    const int first_iteration = iteration;
+
+    double norm = 0;
+    while (iteration < iter_limit) {
+        if (iteration >= orbit_size) {
+            // The reference escaped before this pixel did
+            glitch_metric = 1.0;
+            stats::count(stats::ITERATIONS, iteration - first_iteration);
+            return false;
+        }
+        const double Zr = orbit[iteration].real();
+        const double Zi = orbit[iteration].imag();
+        const double zr = Zr + dzr;
+        const double zi = Zi + dzi;
+        norm = zr * zr + zi * zi;
+        if (norm > 4.0) {
+            break;
+        }
+        const double ref_norm = Zr * Zr + Zi * Zi;
+        if (norm < GLITCH_TOLERANCE * ref_norm) {
+            glitch_metric = norm / ref_norm;
+            stats::count(stats::ITERATIONS, iteration - first_iteration);
+            return false;
+        }
+
+        // z_0 = 0 is not part of the product
+        if (iteration > 0) {
+            const double next_der_r = 2.0 * (zr * der_r - zi * der_i);
+            der_i = 2.0 * (zr * der_i + zi * der_r);
+            der_r = next_der_r;
+            if (der_r * der_r + der_i * der_i < DeepPolicy::INTERIOR_THRESHOLD) {
+                complete_interior(pixel);
+                stats::count(stats::ITERATIONS, iteration - first_iteration);
+                stats::count(stats::PERIODICITY_EXITS);
+                return true;
+            }
+        }
+
+        // dz = 2*Z*dz + dz^2 + dc
+        const double tr = 2.0 * Zr + dzr;
+        const double ti = 2.0 * Zi + dzi;
+        const double next_dzr = tr * dzr - ti * dzi + dcr;
+        dzi = tr * dzi + ti * dzr + dci;
+        dzr = next_dzr;
+        iteration++;
+    }
+
+    stats::count(stats::ITERATIONS, iteration - first_iteration);
+    stats::count(iteration < iter_limit ? stats::ESCAPED : stats::MAX_ITERATION);
+    if (iteration >= iter_limit && pooled) {
+        orbit_pool->save(slot, x, y, iteration, dzr, dzi, der_r, der_i);
+    }
+    complete_pixel<true>(pixel, iteration, iter_limit, norm);
+    return true;
+}
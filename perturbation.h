@@ -0,0 +1,96 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include "FractalisState.h"
+#include "doubledouble.h"
+#include <atomic>
+#include <complex>
+#include <vector>
+
+using namespace doubledouble;
+
+class OrbitPool;
+
+/**
+ * Deep zoom renderer based on perturbation theory.
+ *
+ * One reference orbit Z_n is iterated in DoubleDouble per frame. Every pixel then only iterates its
+ * distance to that orbit, dz_{n+1} = 2*Z_n*dz_n + dz_n^2 + dc, in plain double. A series approximation
+ * lets all pixels skip the first iterations, in which dz is still a polynomial in dc.
+ * Pixels whose delta loses precision ("glitches") are left incomplete and re-rendered against a new
+ * reference inside the glitch, see rebase().
+ */
+class Perturbation {
+public:
+    Perturbation(FractalisState* state, OrbitPool* orbit_pool);
+
+    /**
+     * @brief Compute the reference orbit at the view center and the series approximation for it.
+     */
+    void begin_frame(int iter_limit);
+    /**
+     * @brief Calculate a pixel against the current reference. Glitched pixels stay incomplete.
+     */
+    void calculate_pixel(int x, int y, int iter_limit);
+    /**
+     * @brief Calculate the point at the fractional screen position (x, y) into sample.
+     * @return false if it glitched, glitches of samples don't count for rebase().
+     */
+    bool calculate_sample(double x, double y, int iter_limit, PixelState& sample);
+    /**
+     * @brief Move the reference into the most promising glitched pixel. The series approximation is
+     * only used for the first reference, pixels against later ones iterate from zero.
+     * @return false if no pixel glitched since the last reference was set.
+     */
+    bool rebase(int iter_limit);
+
+    static constexpr int MAX_REFERENCES = 8;
+
+private:
+    FractalisState* state;
+    OrbitPool* orbit_pool;
+    // Still the reference at the view center, i.e. not rebased
+    bool primary_reference;
+
+    // Reference orbit Z_0..Z_n, rounded to double. Rounded to float it put another 0.1 to 1.5% of the pixels
+    // of a view off by some iterations. 16 bytes per iteration, as many as the iteration limit: 52KB at the
+    // 3224 iterations update_iter_limit() picks at MAX_ZOOM
+    std::vector<std::complex<double>> orbit;
+    int orbit_size;
+    // Position of the reference in pixel coordinates and the distance between two pixels
+    double ref_x;
+    double ref_y;
+    double pixel_step;
+
+    // Series approximation dz_n = A*dc + B*dc^2 + C*dc^3 for n = series_skip
+    int series_skip;
+    std::complex<double> series_a;
+    std::complex<double> series_b;
+    std::complex<double> series_c;
+    // dZ_n/dZ_1 of the reference for n = series_skip, where pixels start tracking their own derivative
+    std::complex<double> series_derivative;
+
+    // Best candidate for the next reference: the glitched pixel whose orbit came closest to zero
+    bool glitched;
+    int glitch_x;
+    int glitch_y;
+    double glitch_metric;
+    std::atomic_flag glitch_lock = ATOMIC_FLAG_INIT;
+
+    static constexpr double GLITCH_TOLERANCE = 1e-6;  // |z|^2 < tolerance * |Z|^2, i.e. 1e-3 in magnitude
+    // Max relative error of the series at the probes. Near the boundary the error grows like the orbit's
+    // derivative: at 1e-6 about 6% of the pixels of a view escaped some iterations off from a direct render
+    static constexpr double SERIES_TOLERANCE = 1e-12;
+
+    void compute_reference(const DoubleDouble& re, const DoubleDouble& im, int iter_limit);
+    void compute_series(int iter_limit);
+    void mark_glitch(int x, int y, double metric);
+    /**
+     * @brief Iterate the point dc away from the reference into pixel, (x, y) is its screen position for
+     * the orbit pool or -1 for points that are no pixel.
+     * @return false if it glitched, pixel is untouched then and glitch_metric set.
+     */
+    bool iterate(double dcr, double dci, int iter_limit, PixelState& pixel, double& glitch_metric, int x, int y);
+};
+
+#endif // PERTURBATION_H
@@ -0,0 +1,74 @@
+//
+// Screen areas whose pixels were calculated, from a calculating core to the renderer on core0.
+//
+// One queue per calculating core, each has exactly one producer and one consumer. The producer writes a
+// rectangle before it publishes the new tail with release order, the consumer reads the tail with acquire
+// order, so a rectangle and the pixels calculated before it are visible once it is popped. No locks,
+// neither side ever waits for the other.
+//
+// Rectangles are screen positions of the view they were calculated in. A view change waits until the
+// frame in progress stopped, see FractalisState::beginViewChange(), so every rectangle of the old view is
+// queued before the pixels move, and the full render the change requests drops them.
+//
+
+#ifndef RECTQUEUE_H
+#define RECTQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+// Pixels from (x1, y1) to (x2, y2), corners included
+struct ScreenRect {
+    int16_t x1;
+    int16_t y1;
+    int16_t x2;
+    int16_t y2;
+};
+
+class RectQueue {
+public:
+    // A power of two, 2KB per queue
+    static constexpr uint32_t CAPACITY = 256;
+
+    /**
+     * @brief Publish a rectangle, called by the producer.
+     * @return false if the queue is full. The rectangle is lost then and overflowed() tells the consumer.
+     */
+    bool push(const ScreenRect& rect)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+            overflow.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        rects[t & (CAPACITY - 1)] = rect;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief Take the oldest rectangle, called by the consumer. @return false if the queue is empty. */
+    bool pop(ScreenRect& rect)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        rect = rects[h & (CAPACITY - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief Drop everything queued, called by the consumer before it redraws the whole screen. */
+    void clear() { head.store(tail.load(std::memory_order_acquire), std::memory_order_release); }
+
+    /** @brief Whether rectangles were lost since the last call, the consumer has to redraw everything then. */
+    bool overflowed() { return overflow.exchange(false, std::memory_order_relaxed); }
+
+private:
+    ScreenRect rects[CAPACITY];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<bool> overflow{false};
+};
+
+#endif // RECTQUEUE_H
@@ -0,0 +1,29 @@
+#include "stats.h"
+#include <cstdio>
+
+namespace stats {
+
+std::atomic<uint32_t> counters[COUNTERS];
+std::atomic<uint32_t> timers_us[TIMERS];
+
+void report() {
+    if (!COLLECT_STATS) {
+        return;
+    }
+    uint32_t c[COUNTERS];
+    for (int i = 0; i < COUNTERS; ++i) {
+        c[i] = counters[i].exchange(0, std::memory_order_relaxed);
+    }
+    uint32_t t[TIMERS];
+    for (int i = 0; i < TIMERS; ++i) {
+        t[i] = timers_us[i].exchange(0, std::memory_order_relaxed);
+    }
+    printf("Stats: compute %.1f ms, render %.1f ms, flush %.1f ms | %lu iterations, %lu escaped, %lu at limit, "
+           "%lu bulb, %lu periodic, %lu interrupted\n",
+           t[COMPUTE] / 1000.0, t[RENDER] / 1000.0, t[FLUSH] / 1000.0, static_cast<unsigned long>(c[ITERATIONS]),
+           static_cast<unsigned long>(c[ESCAPED]), static_cast<unsigned long>(c[MAX_ITERATION]),
+           static_cast<unsigned long>(c[BULB_SKIPS]), static_cast<unsigned long>(c[PERIODICITY_EXITS]),
+           static_cast<unsigned long>(c[INTERRUPTED_PASSES]));
+}
+
+} // namespace stats
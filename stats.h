@@ -0,0 +1,58 @@
+//
+// Counters of the hot paths and times of the frame stages, for one summary line per calculation pass.
+//
+// Compiled in with COLLECT_STATS in globals.h. Without it every call is an empty inline function and the
+// kernels are unchanged. Both cores count into the same relaxed atomics, a kernel adds once per pixel or per
+// run of its lanes, not per iteration.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "globals.h"
+#include <atomic>
+#include <cstdint>
+
+namespace stats {
+
+enum Counter {
+    ITERATIONS = 0,     // Iterations the kernels executed. Resumed orbits and series approximation skips don't count
+    ESCAPED,            // Pixels whose orbit escaped
+    MAX_ITERATION,      // Pixels that reached the iteration limit
+    BULB_SKIPS,         // Pixels in the main cardioid or period 2 bulb, not iterated at all
+    PERIODICITY_EXITS,  // Orbits stopped as interior, found periodic or by their shrinking derivative
+    INTERRUPTED_PASSES, // Passes of any render mode interrupted by a new calculation id
+    COUNTERS
+};
+
+enum Timer {
+    COMPUTE = 0,  // Core1 calculating a pass
+    RENDER,       // Drawing pixels and overlay into the frame buffer
+    FLUSH,        // Sending the frame buffer to the display
+    TIMERS
+};
+
+// 32 bits hold a pass of 320x240 pixels at MAX_ITER
+extern std::atomic<uint32_t> counters[COUNTERS];
+extern std::atomic<uint32_t> timers_us[TIMERS];
+
+inline void count(Counter counter, uint32_t n = 1)
+{
+    if (COLLECT_STATS) {
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+inline void add_time(Timer timer, uint32_t us)
+{
+    if (COLLECT_STATS) {
+        timers_us[timer].fetch_add(us, std::memory_order_relaxed);
+    }
+}
+
+/** @brief Print everything counted since the last report in one line and start over. Does nothing without COLLECT_STATS. */
+void report();
+
+} // namespace stats
+
+#endif // STATS_H